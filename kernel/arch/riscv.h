@@ -19,6 +19,7 @@ constexpr uint64_t MSTATUS_MPP_M{3ULL << 11U};
 constexpr uint64_t MSTATUS_MPP_S{1ULL << 11U};
 constexpr uint64_t MSTATUS_MPP_U{0ULL << 11U};
 
+constexpr uint64_t MIE_MSIE{1U << 3U};
 constexpr uint64_t MIE_STIE{1U << 5U};
 __attribute__((always_inline)) static inline auto r_mie() -> uint64_t {
   uint64_t x = 0;
@@ -49,6 +50,16 @@ __attribute__((always_inline)) static inline auto r_mcounteren() -> uint64_t {
   return x;
 }
 
+__attribute__((always_inline)) static inline auto w_scounteren(uint64_t x)
+    -> void {
+  asm volatile("csrw scounteren, %0" : : "r"(x));
+}
+__attribute__((always_inline)) static inline auto r_scounteren() -> uint64_t {
+  uint64_t x = 0;
+  asm volatile("csrr %0, scounteren" : "=r"(x));
+  return x;
+}
+
 __attribute__((always_inline)) static inline auto r_mstatus() -> uint64_t {
   uint64_t rs{};
   asm volatile("csrr %0, mstatus" : "=r"(rs));
@@ -85,6 +96,15 @@ __attribute__((always_inline)) static inline auto w_mideleg(uint64_t value)
   asm volatile("csrw mideleg, %0" : : "r"(value));
 };
 
+__attribute__((always_inline)) static inline auto w_mtvec(uint64_t value)
+    -> void {
+  asm volatile("csrw mtvec, %0" : : "r"(value));
+};
+__attribute__((always_inline)) static inline auto w_mscratch(uint64_t value)
+    -> void {
+  asm volatile("csrw mscratch, %0" : : "r"(value));
+};
+
 __attribute__((always_inline)) static inline auto w_pmpaddr0(uint64_t value)
     -> void {
   asm volatile("csrw pmpaddr0, %0" : : "r"(value));
@@ -105,8 +125,14 @@ __attribute__((always_inline)) static inline auto r_time() -> uint64_t {
 constexpr uint64_t SIE_SEIE{1U << 9U};  // extenal
 constexpr uint64_t SIE_STIE{1U << 5U};  // time
 constexpr uint64_t SIE_SSIE{1U << 1U};  // software
+constexpr uint64_t SIP_SSIP{1U << 1U};
 
 // clang-format off
+constexpr uint32_t SSTATUS_FS{3U << 13U};  // Floating-point unit state
+constexpr uint32_t SSTATUS_FS_OFF{0U << 13U};
+constexpr uint32_t SSTATUS_FS_INITIAL{1U << 13U};
+constexpr uint32_t SSTATUS_FS_CLEAN{2U << 13U};
+constexpr uint32_t SSTATUS_FS_DIRTY{3U << 13U};
 constexpr uint32_t SSTATUS_SPP{1U << 8U};  // Previous mode, 1=Supervisor, 0=User
 constexpr uint32_t SSTATUS_SPIE{1U << 5U};  // Supervisor Previous Interrupt Enable
 constexpr uint32_t SSTATUS_UPIE{1U << 4U};  // User Previous Interrupt Enable
@@ -124,6 +150,16 @@ __attribute__((always_inline)) static inline auto r_sie() -> uint64_t {
   return rs;
 };
 
+__attribute__((always_inline)) static inline auto r_sip() -> uint64_t {
+  uint64_t rs{};
+  asm volatile("csrr %0, sip" : "=r"(rs));
+  return rs;
+};
+__attribute__((always_inline)) static inline auto w_sip(uint64_t value)
+    -> void {
+  asm volatile("csrw sip, %0" : : "r"(value));
+};
+
 __attribute__((always_inline)) static inline auto sfence_vma() -> void {
   asm volatile("sfence.vma zero, zero");
 };
@@ -190,6 +226,7 @@ constexpr uint64_t PTE_R{1ULL << 1U};
 constexpr uint64_t PTE_W{1ULL << 2U};
 constexpr uint64_t PTE_X{1ULL << 3U};
 constexpr uint64_t PTE_U{1ULL << 4U};
+constexpr uint64_t PTE_COW{1ULL << 8U};  // rsw bit, write faults copy the page
 
 constexpr uint32_t PGSIZE{4096U};
 
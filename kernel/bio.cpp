@@ -12,7 +12,7 @@ namespace bio {
 
 class bcache {
  public:
-  class lock::spinlock lock{};
+  class lock::spinlock lock{"bcache", lock::kind::MCS};
   class buf buf[fs::NBUF]{};
   class buf head{};
 } bcache{};
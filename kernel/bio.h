@@ -12,7 +12,7 @@ class buf {
   uint32_t dev{0};
   uint32_t blockno{0};
   uint32_t refcnt{0};
-  class lock::sleeplock lock{};
+  class lock::sleeplock lock{"buf"};
   class buf *prev{nullptr};  // LRU cache list
   class buf *next{nullptr};
   unsigned char data[fs::BSIZE]{0};
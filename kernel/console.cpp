@@ -4,6 +4,7 @@
 
 #include "file.h"
 #include "lock.h"
+#include "poll.h"
 #include "proc.h"
 #include "uart.h"
 
@@ -14,13 +15,15 @@ constexpr uint32_t BACKSPACE{0x100};
 constexpr auto C = [](int x) -> int { return ((x) - '@'); };
 
 struct {
-  class lock::spinlock lock{};
+  class lock::spinlock lock{"cons"};
 
   // input
   char buf[INPUT_BUF_SIZE]{};
   uint32_t r{};  // Read index
   uint32_t w{};  // Write index
   uint32_t e{};  // Edit index
+
+  struct poll::waitq wq{};
 } cons{};
 
 auto putc(int c) -> void {
@@ -33,20 +36,24 @@ auto putc(int c) -> void {
   }
 }
 
-auto write(bool user_src, uint64_t src, int n) -> int {
+auto write(bool user_src, uint64_t src, int n, bool nonblock) -> int {
   auto i{0};
   for (; i < n; ++i) {
     char c = 0;
-    if (proc::either_copyin(&c, user_src, src + i, 1) != 1) {
+    if (proc::either_copyin(&c, user_src, src + i, 1) == -1) {
       break;
     }
-    uart::putc(c);
+    if (nonblock == false) {
+      uart::putc(c);
+    } else if (uart::try_putc(c) == false) {
+      return i > 0 ? i : -file::EAGAIN;
+    }
   }
 
   return i;
 }
 
-auto read(bool user_dst, uint64_t dst, int n) -> int {
+auto read(bool user_dst, uint64_t dst, int n, bool nonblock) -> int {
   auto target = n;
   cons.lock.acquire();
   while (n > 0) {
@@ -57,6 +64,10 @@ auto read(bool user_dst, uint64_t dst, int n) -> int {
         cons.lock.release();
         return -1;
       }
+      if (nonblock) {
+        cons.lock.release();
+        return n < target ? target - n : -file::EAGAIN;
+      }
       proc::sleep(&cons.r, cons.lock);
     }
 
@@ -91,6 +102,16 @@ auto read(bool user_dst, uint64_t dst, int n) -> int {
   return target - n;
 }
 
+auto poll_mask() -> uint32_t {
+  uint32_t mask{poll::POLLOUT};
+  cons.lock.acquire();
+  if (cons.r != cons.w) {
+    mask |= poll::POLLIN;
+  }
+  cons.lock.release();
+  return mask;
+}
+
 void intr(int c) {
   cons.lock.acquire();
 
@@ -124,6 +145,7 @@ void intr(int c) {
           // has arrived.
           cons.w = cons.e;
           proc::wakeup(&cons.r);
+          poll::notify(cons.wq, poll::POLLIN);
         }
       }
       break;
@@ -139,5 +161,7 @@ auto init() -> void {
   // to consoleread and consolewrite.
   file::devsw[file::CONSOLE].read = read;
   file::devsw[file::CONSOLE].write = write;
+  file::devsw[file::CONSOLE].poll = poll_mask;
+  file::devsw[file::CONSOLE].wq = &cons.wq;
 }
 }  // namespace console
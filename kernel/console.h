@@ -4,7 +4,8 @@
 namespace console {
 auto init() -> void;
 void intr(int c);
-auto read(bool user_dst, uint64_t dst, int n) -> int;
-auto write(bool user_src, uint64_t src, int n) -> int;
+auto read(bool user_dst, uint64_t dst, int n, bool nonblock) -> int;
+auto write(bool user_src, uint64_t src, int n, bool nonblock) -> int;
 auto putc(int c) -> void;
+auto poll_mask() -> uint32_t;
 } // namespace console
@@ -0,0 +1,144 @@
+#include "fdtable.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "file.h"
+#include "vm.h"
+
+namespace file {
+constexpr uint64_t FULL_MASK{NFDWORD == 64 ? ~0ULL : (1ULL << NFDWORD) - 1};
+
+auto install(struct fdtable &fdt, struct file *f) -> int {
+  if (fdt.full == FULL_MASK) {
+    return -1;
+  }
+
+  auto w = static_cast<uint32_t>(__builtin_ctzll(~fdt.full));
+  auto b = static_cast<uint32_t>(__builtin_ctzll(~fdt.bitmap[w]));
+  auto fd = w * 64 + b;
+
+  auto pg = fd / FD_PER_PAGE;
+  if (fdt.page[pg] == nullptr) {
+    auto opt_page = vm::kalloc();
+    if (!opt_page.has_value()) {
+      return -1;
+    }
+    std::memset(opt_page.value(), 0, PGSIZE);
+    fdt.page[pg] = (struct file **)opt_page.value();
+  }
+
+  fdt.page[pg][fd % FD_PER_PAGE] = f;
+  fdt.bitmap[w] |= 1ULL << b;
+  if (fdt.bitmap[w] == ~0ULL) {
+    fdt.full |= 1ULL << w;
+  }
+  return static_cast<int>(fd);
+}
+
+auto get(struct fdtable &fdt, int fd) -> struct file * {
+  if (fd < 0 || fd >= static_cast<int>(NOFILE)) {
+    return nullptr;
+  }
+  if ((fdt.bitmap[fd / 64] & (1ULL << (fd % 64))) == 0) {
+    return nullptr;
+  }
+  return fdt.page[fd / FD_PER_PAGE][fd % FD_PER_PAGE];
+}
+
+auto remove(struct fdtable &fdt, int fd) -> struct file * {
+  auto *f = get(fdt, fd);
+  if (f == nullptr) {
+    return nullptr;
+  }
+  fdt.page[fd / FD_PER_PAGE][fd % FD_PER_PAGE] = nullptr;
+  fdt.bitmap[fd / 64] &= ~(1ULL << (fd % 64));
+  fdt.full &= ~(1ULL << (fd / 64));
+  return f;
+}
+
+auto fd_install(struct fdtable &fdt, struct file *f) -> int {
+  fdt.lock.acquire();
+  auto fd = install(fdt, f);
+  fdt.lock.release();
+  return fd;
+}
+
+// the reference is taken under the lock, so a close from another
+// thread cannot free f while the caller still uses it
+auto fd_get(struct fdtable &fdt, int fd) -> struct file * {
+  fdt.lock.acquire();
+  auto *f = get(fdt, fd);
+  if (f != nullptr) {
+    dup(f);
+  }
+  fdt.lock.release();
+  return f;
+}
+
+auto fd_remove(struct fdtable &fdt, int fd) -> struct file * {
+  fdt.lock.acquire();
+  auto *f = remove(fdt, fd);
+  fdt.lock.release();
+  return f;
+}
+
+// dst is new and not shared yet
+auto fd_copy(struct fdtable &dst, struct fdtable &src) -> bool {
+  src.lock.acquire();
+  for (uint32_t i{0}; i < NFDPAGE; ++i) {
+    if (src.page[i] == nullptr) {
+      continue;
+    }
+    auto opt_page = vm::kalloc();
+    if (!opt_page.has_value()) {
+      src.lock.release();
+      fd_free(dst);
+      return false;
+    }
+    dst.page[i] = (struct file **)opt_page.value();
+    std::memmove(dst.page[i], src.page[i], PGSIZE);
+  }
+  std::memmove(dst.bitmap, src.bitmap, sizeof(dst.bitmap));
+  dst.full = src.full;
+
+  // only the descriptors actually in use need a new reference
+  for (uint32_t w{0}; w < NFDWORD; ++w) {
+    for (auto bits = src.bitmap[w]; bits != 0; bits &= bits - 1) {
+      auto fd = w * 64 + static_cast<uint32_t>(__builtin_ctzll(bits));
+      dup(dst.page[fd / FD_PER_PAGE][fd % FD_PER_PAGE]);
+    }
+  }
+  src.lock.release();
+  return true;
+}
+
+// close may sleep, so the lock is dropped around each one
+auto fd_close_all(struct fdtable &fdt) -> void {
+  for (uint32_t w{0}; w < NFDWORD; ++w) {
+    while (true) {
+      fdt.lock.acquire();
+      auto bits = fdt.bitmap[w];
+      if (bits == 0) {
+        fdt.lock.release();
+        break;
+      }
+      auto fd = w * 64 + static_cast<uint32_t>(__builtin_ctzll(bits));
+      auto *f = remove(fdt, static_cast<int>(fd));
+      fdt.lock.release();
+      close(f);
+    }
+  }
+}
+
+auto fd_free(struct fdtable &fdt) -> void {
+  for (auto &page : fdt.page) {
+    if (page != nullptr) {
+      vm::kfree(page);
+    }
+    page = nullptr;
+  }
+  std::memset(fdt.bitmap, 0, sizeof(fdt.bitmap));
+  fdt.full = 0;
+}
+}  // namespace file
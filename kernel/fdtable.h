@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+
+#include "file.h"
+#include "lock.h"
+
+namespace file {
+constexpr uint32_t FD_PER_PAGE{4096 / sizeof(struct file *)};
+constexpr uint32_t NFDPAGE{8};
+constexpr uint32_t NOFILE{FD_PER_PAGE * NFDPAGE};
+constexpr uint32_t NFDWORD{NOFILE / 64};
+
+static_assert(NFDWORD <= 64, "fdtable: summary word too small");
+
+// per-process descriptor table. slots live in kalloc'd pages that are
+// only allocated once a descriptor in their range is used, the two
+// level bitmap gives the lowest free descriptor with two ctz.
+struct fdtable {
+  class lock::spinlock lock{};
+  struct file **page[NFDPAGE];
+  uint64_t full;               // bit i set: bitmap[i] has no free bit
+  uint64_t bitmap[NFDWORD];    // bit set: descriptor in use
+};
+
+auto fd_install(struct fdtable &fdt, struct file *f) -> int;
+// takes a reference, file::close it when done
+auto fd_get(struct fdtable &fdt, int fd) -> struct file *;
+auto fd_remove(struct fdtable &fdt, int fd) -> struct file *;
+auto fd_copy(struct fdtable &dst, struct fdtable &src) -> bool;
+auto fd_close_all(struct fdtable &fdt) -> void;
+auto fd_free(struct fdtable &fdt) -> void;
+}  // namespace file
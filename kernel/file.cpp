@@ -1,63 +1,91 @@
 #include "file.h"
 
 #include <cstdint>
+#include <cstring>
 #include <fmt>
 
+#include "bio.h"
 #include "fs.h"
 #include "lock.h"
 #include "log.h"
 #include "pipe.h"
+#include "poll.h"
 #include "proc.h"
 #include "vm.h"
 
 namespace file {
 struct devsw devsw[NDEV];
 
+// file objects are carved out of kalloc'd pages and kept on a free
+// list, the table grows a page at a time when the list runs dry.
+constexpr uint32_t FILE_PER_PAGE{PGSIZE / sizeof(struct file)};
+
 struct {
-  class lock::spinlock lock{};
-  struct file file[NFILE];
+  class lock::spinlock lock{"ftable", lock::kind::TICKET};
+  struct file* freelist{nullptr};
 } ftable;
 
+auto grow() -> bool {
+  auto opt_page = vm::kalloc();
+  if (!opt_page.has_value()) {
+    return false;
+  }
+  auto* files = (struct file*)opt_page.value();
+  for (uint32_t i{0}; i < FILE_PER_PAGE; ++i) {
+    files[i].ref = 0;
+    files[i].type = file::FD_NONE;
+    files[i].next = ftable.freelist;
+    ftable.freelist = &files[i];
+  }
+  return true;
+}
+
 auto alloc() -> struct file* {
   ftable.lock.acquire();
-  for (auto& file : ftable.file) {
-    if (file.ref == 0) {
-      file.ref = 1;
-      ftable.lock.release();
-      return &file;
-    }
+  if (ftable.freelist == nullptr && grow() == false) {
+    ftable.lock.release();
+    return nullptr;
   }
+  auto* f = ftable.freelist;
+  ftable.freelist = f->next;
   ftable.lock.release();
-  return nullptr;
+
+  std::memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 auto dup(struct file* f) -> struct file* {
-  ftable.lock.acquire();
-  if (f->ref < 1) {
+  if (__atomic_fetch_add(&f->ref, 1, __ATOMIC_ACQ_REL) < 1) {
     fmt::panic("file::dup");
   }
-  ++f->ref;
-  ftable.lock.release();
   return f;
 }
 
 auto close(struct file* f) -> void {
-  ftable.lock.acquire();
-  if (f->ref < 1) {
+  auto ref = __atomic_sub_fetch(&f->ref, 1, __ATOMIC_ACQ_REL);
+  if (ref < 0) {
     fmt::panic("file::close");
   }
-  if (--f->ref > 0) {
-    ftable.lock.release();
+  if (ref > 0) {
     return;
   }
 
+  // last reference, nobody else can see f any more
+  if (__atomic_load_n(&f->epitems, __ATOMIC_ACQUIRE) != nullptr) {
+    poll::epoll_forget(f);
+  }
   auto ff = *f;
-  f->ref = 0;
   f->type = file::FD_NONE;
+  ftable.lock.acquire();
+  f->next = ftable.freelist;
+  ftable.freelist = f;
   ftable.lock.release();
 
   if (ff.type == file::FD_PIPE) {
     pipeclose(ff.pipe, ff.writable);
+  } else if (ff.type == file::FD_EPOLL) {
+    poll::epoll_release(ff.ep);
   } else if (ff.type == file::FD_INODE || ff.type == file::FD_DEVICE) {
     log::begin_op();
     fs::iput(ff.ip);
@@ -87,13 +115,13 @@ auto read(struct file* f, uint64_t addr, int n) -> int {
 
   int rs = 0;
   if (f->type == file::FD_PIPE) {
-    rs = piperead(f->pipe, addr, n);
+    rs = piperead(f->pipe, true, addr, n, (f->flags & O_NONBLOCK) != 0);
   } else if (f->type == file::FD_DEVICE) {
     if (f->major < 0 || f->major >= static_cast<int16_t>(NDEV) ||
         !devsw[f->major].read) {
       return -1;
     }
-    rs = devsw[f->major].read(true, addr, n);
+    rs = devsw[f->major].read(true, addr, n, (f->flags & O_NONBLOCK) != 0);
   } else if (f->type == file::FD_INODE) {
     fs::ilock(f->ip);
     rs = static_cast<int>(fs::readi(f->ip, true, addr, f->off, n));
@@ -116,13 +144,13 @@ auto write(struct file* f, uint64_t addr, int n) -> int {
   auto rs{0};
   auto r{0};
   if (f->type == file::FD_PIPE) {
-    rs = pipewrite(f->pipe, addr, n);
+    rs = pipewrite(f->pipe, true, addr, n, (f->flags & O_NONBLOCK) != 0);
   } else if (f->type == T_DEVICE) {
     if (f->major < 0 || f->major >= static_cast<int16_t>(NDEV) ||
         !devsw[f->major].write) {
       return -1;
     }
-    rs = devsw[f->major].write(1, addr, n);
+    rs = devsw[f->major].write(1, addr, n, (f->flags & O_NONBLOCK) != 0);
   } else if (f->type == ::file::file::FD_INODE) {
     int max = ((fs::MAXOPBLOCKS - 1 - 1 - 2) / 2) * fs::BSIZE;
     int i = 0;
@@ -151,4 +179,360 @@ auto write(struct file* f, uint64_t addr, int n) -> int {
 
   return rs;
 }
+
+auto readv(struct file* f, const struct iovec* iov, int iovcnt) -> int {
+  if (f->readable == false) {
+    return -1;
+  }
+
+  auto tot{0};
+  if (f->type == file::FD_INODE) {
+    // hold the inode lock once for the whole vector so the
+    // segments are read from one consistent offset range.
+    fs::ilock(f->ip);
+    for (auto i{0}; i < iovcnt; ++i) {
+      auto n = static_cast<uint32_t>(iov[i].iov_len);
+      auto r = fs::readi(f->ip, true, iov[i].iov_base, f->off, n);
+      if (static_cast<int>(r) < 0) {
+        fs::iunlock(f->ip);
+        return tot > 0 ? tot : -1;
+      }
+      f->off += r;
+      tot += static_cast<int>(r);
+      if (r != n) {
+        break;
+      }
+    }
+    fs::iunlock(f->ip);
+    return tot;
+  }
+
+  for (auto i{0}; i < iovcnt; ++i) {
+    auto n = static_cast<int>(iov[i].iov_len);
+    auto r = read(f, iov[i].iov_base, n);
+    if (r < 0) {
+      return tot > 0 ? tot : r;
+    }
+    tot += r;
+    if (r != n) {
+      // a short read from a pipe or device means no more data is
+      // ready, don't block again for the next segment.
+      break;
+    }
+  }
+  return tot;
+}
+
+auto writev(struct file* f, const struct iovec* iov, int iovcnt) -> int {
+  if (f->writable == false) {
+    return -1;
+  }
+
+  auto total{0};
+  for (auto i{0}; i < iovcnt; ++i) {
+    total += static_cast<int>(iov[i].iov_len);
+  }
+
+  if (f->type != ::file::file::FD_INODE) {
+    auto done{0};
+    for (auto i{0}; i < iovcnt; ++i) {
+      auto n = static_cast<int>(iov[i].iov_len);
+      if (n == 0) {
+        continue;
+      }
+      auto r = write(f, iov[i].iov_base, n);
+      if (r < 0) {
+        return done > 0 ? done : r;
+      }
+      done += r;
+      if (r != n) {
+        // a non-blocking write stops short when full, a blocking one
+        // only on error. either way report what already went out.
+        return done > 0 || (f->flags & O_NONBLOCK) != 0 ? done : -1;
+      }
+    }
+    return done;
+  }
+
+  // all segments share one log transaction, a new one is only started
+  // when the blocks written so far would overflow MAXOPBLOCKS.
+  int max = ((fs::MAXOPBLOCKS - 1 - 1 - 2) / 2) * fs::BSIZE;
+  auto budget{0};
+  auto tot{0};
+  auto failed{false};
+
+  log::begin_op();
+  fs::ilock(f->ip);
+  for (auto i{0}; i < iovcnt && failed == false; ++i) {
+    auto n = static_cast<int>(iov[i].iov_len);
+    auto j{0};
+    while (j < n) {
+      if (budget == max) {
+        fs::iunlock(f->ip);
+        log::end_op();
+        log::begin_op();
+        fs::ilock(f->ip);
+        budget = 0;
+      }
+
+      int n1 = n - j;
+      if (n1 > max - budget) n1 = max - budget;
+
+      auto r = fs::writei(f->ip, true, iov[i].iov_base + j, f->off, n1);
+      if (r > 0) {
+        f->off += r;
+        j += r;
+        tot += r;
+        budget += r;
+      }
+      if (r != n1) {
+        // error from writei
+        failed = true;
+        break;
+      }
+    }
+  }
+  fs::iunlock(f->ip);
+  log::end_op();
+
+  return (tot == total ? total : -1);
+}
+
+auto poll_mask(struct file* f) -> uint32_t {
+  if (f->type == file::FD_PIPE) {
+    auto mask = pipepoll(f->pipe);
+    if (f->readable) {
+      return mask & (poll::POLLIN | poll::POLLHUP);
+    }
+    return mask & (poll::POLLOUT | poll::POLLERR);
+  }
+  if (f->type == file::FD_DEVICE) {
+    if (f->major < 0 || f->major >= static_cast<int16_t>(NDEV)) {
+      return poll::POLLERR;
+    }
+    if (devsw[f->major].poll == nullptr) {
+      return poll::POLLIN | poll::POLLOUT;
+    }
+    return devsw[f->major].poll();
+  }
+  if (f->type == file::FD_INODE) {
+    return poll::POLLIN | poll::POLLOUT;
+  }
+  return 0;
+}
+
+auto poll_queue(struct file* f) -> struct poll::waitq* {
+  if (f->type == file::FD_PIPE) {
+    return &f->pipe->wq;
+  }
+  if (f->type == file::FD_DEVICE && f->major >= 0 &&
+      f->major < static_cast<int16_t>(NDEV)) {
+    return devsw[f->major].wq;
+  }
+  return nullptr;
+}
+
+// write kernel memory to f, sendfile and splice use it so that the
+// data never has to cross into user space.
+auto write_kernel(struct file* f, const char* src, int n, bool nonblock)
+    -> int {
+  if (f->type == file::FD_PIPE) {
+    return static_cast<int>(
+        pipewrite(f->pipe, false, (uint64_t)src, n, nonblock));
+  }
+  if (f->type == file::FD_DEVICE) {
+    if (f->major < 0 || f->major >= static_cast<int16_t>(NDEV) ||
+        !devsw[f->major].write) {
+      return -1;
+    }
+    return devsw[f->major].write(false, (uint64_t)src, n, nonblock);
+  }
+  if (f->type == file::FD_INODE) {
+    log::begin_op();
+    fs::ilock(f->ip);
+    auto r = fs::writei(f->ip, false, (uint64_t)src, f->off, n);
+    if (r > 0) {
+      f->off += r;
+    }
+    fs::iunlock(f->ip);
+    log::end_op();
+    return r;
+  }
+  return -1;
+}
+
+auto sendfile(struct file* out, struct file* in, uint32_t& off, int n) -> int {
+  if (in->readable == false || out->writable == false) {
+    return -1;
+  }
+  if (in->type != file::FD_INODE) {
+    return -1;
+  }
+  if (out->type == file::FD_INODE && out->ip == in->ip) {
+    return -1;
+  }
+
+  // the block is copied out and released before the write, which may
+  // sleep on a full pipe or wait in begin_op for a commit that needs it.
+  auto opt_page = vm::kalloc();
+  if (!opt_page.has_value()) {
+    return -1;
+  }
+  auto* page = (char*)opt_page.value();
+
+  auto tot{0};
+  while (tot < n) {
+    fs::ilock(in->ip);
+    if (off >= in->ip->size) {
+      fs::iunlock(in->ip);
+      break;
+    }
+    auto m = static_cast<uint32_t>(n - tot);
+    if (m > fs::BSIZE - off % fs::BSIZE) {
+      m = fs::BSIZE - off % fs::BSIZE;
+    }
+    if (m > in->ip->size - off) {
+      m = in->ip->size - off;
+    }
+    auto addr = fs::bmap(in->ip, off / fs::BSIZE);
+    fs::iunlock(in->ip);
+    if (addr == 0) {
+      break;
+    }
+
+    auto* bp = bio::bread(in->ip->dev, addr);
+    std::memmove(page, (char*)bp->data + off % fs::BSIZE, m);
+    bio::brelse(*bp);
+    auto r = write_kernel(out, page, static_cast<int>(m),
+                          (out->flags & O_NONBLOCK) != 0);
+
+    if (r <= 0) {
+      if (tot == 0) {
+        tot = r == -EAGAIN ? r : -1;
+      }
+      break;
+    }
+    off += r;
+    tot += r;
+    if (r != static_cast<int>(m)) {
+      break;
+    }
+  }
+  vm::kfree(page);
+  return tot;
+}
+
+auto splice(struct file* in, struct file* out, int n) -> int {
+  if (in->type != file::FD_PIPE && out->type != file::FD_PIPE) {
+    return -1;
+  }
+  if (in->type == file::FD_INODE) {
+    return sendfile(out, in, in->off, n);
+  }
+  if (in->type != file::FD_PIPE || in->readable == false ||
+      out->writable == false) {
+    return -1;
+  }
+
+  auto opt_page = vm::kalloc();
+  if (!opt_page.has_value()) {
+    return -1;
+  }
+  auto* page = (char*)opt_page.value();
+
+  if (n > static_cast<int>(PGSIZE)) {
+    n = PGSIZE;
+  }
+  // take whatever the pipe has right now, like a read(2) would.
+  auto got = static_cast<int>(piperead(in->pipe, false, (uint64_t)page, n,
+                                       (in->flags & O_NONBLOCK) != 0));
+  auto tot{0};
+  while (tot < got) {
+    auto m = got - tot;
+    if (m > static_cast<int>(fs::BSIZE)) {
+      m = fs::BSIZE;
+    }
+    // the bytes are already gone from the pipe, push them out even
+    // when out is non-blocking.
+    auto r = write_kernel(out, page + tot, m, false);
+    if (r <= 0) {
+      break;
+    }
+    tot += r;
+  }
+
+  vm::kfree(page);
+  if (got < 0) {
+    return got;
+  }
+  return tot > 0 || got == 0 ? tot : -1;
+}
+
+// with SPLICE_F_GIFT every page aligned whole page of the vector is
+// handed to the pipe instead of copied, the ragged edges are copied.
+auto vmsplice(struct file* f, const struct iovec* iov, int iovcnt,
+              uint32_t flags) -> int {
+  if (f->type != file::FD_PIPE || f->writable == false) {
+    return -1;
+  }
+  auto nonblock = (f->flags & O_NONBLOCK) != 0;
+  auto gift = (flags & SPLICE_F_GIFT) != 0;
+
+  auto tot{0};
+  for (auto i{0}; i < iovcnt; ++i) {
+    auto base = iov[i].iov_base;
+    auto len = iov[i].iov_len;
+    while (len > 0) {
+      int r = 0;
+      auto m = len;
+      if (gift && base % PGSIZE == 0 && len >= PGSIZE) {
+        m = PGSIZE;
+        r = pipegift(f->pipe, base, nonblock);
+      } else {
+        if (gift && m > PGSIZE - base % PGSIZE) {
+          m = PGSIZE - base % PGSIZE;
+        }
+        r = static_cast<int>(pipewrite(f->pipe, true, base,
+                                       static_cast<int>(m), nonblock));
+      }
+      if (r < 0) {
+        return tot > 0 ? tot : r;
+      }
+      tot += r;
+      if (r != static_cast<int>(m)) {
+        return tot;
+      }
+      base += m;
+      len -= m;
+    }
+  }
+  return tot;
+}
+
+auto fcntl(struct file* f, int cmd, uint64_t arg) -> int {
+  if (cmd == F_GETFL) {
+    uint32_t mode{O_RDONLY};
+    if (f->readable && f->writable) {
+      mode = O_RDWR;
+    } else if (f->writable) {
+      mode = O_WRONLY;
+    }
+    return static_cast<int>(mode | f->flags);
+  }
+  if (cmd == F_SETFL) {
+    // only the status flags can change, the access mode is fixed at open
+    f->flags = static_cast<uint32_t>(arg) & O_NONBLOCK;
+    return 0;
+  }
+  if (f->type != file::FD_PIPE) {
+    return -1;
+  }
+  if (cmd == F_SETPIPE_SZ) {
+    return piperesize(f->pipe, static_cast<uint32_t>(arg));
+  }
+  if (cmd == F_GETPIPE_SZ) {
+    return static_cast<int>(f->pipe->size);
+  }
+  return -1;
+}
 }  // namespace file
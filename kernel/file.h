@@ -5,16 +5,26 @@
 #include "kernel/fs"
 #include "lock.h"
 
+namespace poll {
+struct waitq;
+struct eventpoll;
+struct epitem;
+}  // namespace poll
+
 namespace file {
 struct file {
-  enum : uint8_t { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
-  int ref;
+  enum : uint8_t { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_EPOLL } type;
+  int ref;  // updated with atomics, no lock needed
   bool readable;
   bool writable;
   struct pipe* pipe;
   struct inode* ip;
+  struct poll::eventpoll* ep;
+  struct poll::epitem* epitems;  // epoll sets watching it
   uint32_t off;
+  uint32_t flags;  // status flags, O_NONBLOCK
   int16_t major;
+  struct file* next;  // free list link while unused
 };
 
 static inline auto major(uint32_t dev) -> uint32_t {
@@ -42,12 +52,19 @@ struct inode {
   int16_t nlink;
   uint32_t size;
   uint32_t addrs[fs::NDIRECT + 1];
-  class lock::sleeplock lock{};
+  class lock::sleeplock lock{"inode"};
+};
+
+struct iovec {
+  uint64_t iov_base;
+  uint64_t iov_len;
 };
 
 struct devsw {
-  int (*read)(bool, uint64_t, int);
-  int (*write)(bool, uint64_t, int);
+  int (*read)(bool, uint64_t, int, bool);  // last: don't block
+  int (*write)(bool, uint64_t, int, bool);
+  uint32_t (*poll)();        // current readiness, nullptr: always ready
+  struct poll::waitq* wq;    // notified on readiness changes
 };
 
 extern struct devsw devsw[];
@@ -68,17 +85,26 @@ struct stat {
   uint32_t gid;
 };
 
-constexpr uint32_t NOFILE{16};
-constexpr uint32_t NFILE{100};
 constexpr uint32_t NDEV{10};
 
 constexpr uint32_t MAXPATH{128};
+constexpr uint32_t IOV_MAX{16};
+constexpr uint32_t SPLICE_F_GIFT{0x08};
 
 constexpr uint32_t O_RDONLY{0x000};
 constexpr uint32_t O_WRONLY{0x001};
 constexpr uint32_t O_RDWR{0x002};
 constexpr uint32_t O_CREATE{0x200};
 constexpr uint32_t O_TRUNC{0x400};
+constexpr uint32_t O_NONBLOCK{0x800};
+
+constexpr int F_GETFL{3};
+constexpr int F_SETFL{4};
+constexpr int F_SETPIPE_SZ{1031};
+constexpr int F_GETPIPE_SZ{1032};
+
+// returned negated by a non-blocking read or write that would sleep
+constexpr int EAGAIN{11};
 
 auto alloc() -> struct file*;
 auto dup(struct file* f) -> struct file*;
@@ -86,4 +112,13 @@ auto close(struct file* f) -> void;
 auto stat(struct file* f, uint64_t addr) -> int;
 auto read(struct file* f, uint64_t addr, int n) -> int;
 auto write(struct file* f, uint64_t addr, int n) -> int;
+auto readv(struct file* f, const struct iovec* iov, int iovcnt) -> int;
+auto writev(struct file* f, const struct iovec* iov, int iovcnt) -> int;
+auto poll_mask(struct file* f) -> uint32_t;
+auto poll_queue(struct file* f) -> struct poll::waitq*;
+auto sendfile(struct file* out, struct file* in, uint32_t& off, int n) -> int;
+auto splice(struct file* in, struct file* out, int n) -> int;
+auto vmsplice(struct file* f, const struct iovec* iov, int iovcnt,
+              uint32_t flags) -> int;
+auto fcntl(struct file* f, int cmd, uint64_t arg) -> int;
 }  // namespace file
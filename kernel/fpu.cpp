@@ -0,0 +1,91 @@
+#include "fpu.h"
+
+#include <cstdint>
+
+#ifndef ARCH_RISCV
+#include "arch/riscv.h"
+#define ARCH_RISCV
+#endif
+
+#include "lock.h"
+#include "proc.h"
+
+extern "C" auto fpu_save(struct proc::fpstate *fp) -> void;
+extern "C" auto fpu_restore(struct proc::fpstate *fp) -> void;
+extern "C" auto fpu_clear() -> void;
+
+namespace fpu {
+// process whose state each hart's registers last held
+struct proc::process *owner[proc::NCPU];
+
+static inline auto fs() -> uint64_t { return r_sstatus() & SSTATUS_FS; }
+
+static inline auto set_fs(uint64_t state) -> void {
+  w_sstatus((r_sstatus() & ~SSTATUS_FS) | state);
+}
+
+// called by the scheduler before switching to p. when nobody else has
+// loaded this hart's registers since p left it, p continues clean with
+// no restore at all.
+auto switch_in(struct proc::process *p) -> void {
+  auto id = proc::cpuid();
+  set_fs(owner[id] == p && p->fp_cpu == id ? SSTATUS_FS_CLEAN
+                                           : SSTATUS_FS_OFF);
+}
+
+// called by the scheduler once p is off its hart. the registers stay
+// loaded, so only a dirty unit costs a save.
+auto switch_out(struct proc::process *p) -> void {
+  if (fs() == SSTATUS_FS_DIRTY && p->status != proc::proc_status::ZOMBIE) {
+    fpu_save(&p->fp);
+  }
+  set_fs(SSTATUS_FS_OFF);
+}
+
+// illegal instruction from user mode. with the unit off it was most
+// likely an fp instruction, so load p's state and retry it. anything
+// else traps again with the unit on and is not ours.
+auto trap(struct proc::process *p) -> bool {
+  if (fs() != SSTATUS_FS_OFF) {
+    return false;
+  }
+
+  auto id = proc::cpuid();
+  if (p->fp_used) {
+    set_fs(SSTATUS_FS_CLEAN);
+    fpu_restore(&p->fp);
+    set_fs(SSTATUS_FS_CLEAN);
+  } else {
+    set_fs(SSTATUS_FS_INITIAL);
+    fpu_clear();
+    set_fs(SSTATUS_FS_INITIAL);
+    // the slot may hold an earlier process's registers, and switch_out
+    // does not save a unit left in Initial
+    p->fp = {};
+    p->fp_used = true;
+  }
+  owner[id] = p;
+  p->fp_cpu = id;
+  return true;
+}
+
+// write back live registers so p->fp can be copied, for fork and clone
+auto flush(struct proc::process *p) -> void {
+  lock::push_off();
+  if (fs() == SSTATUS_FS_DIRTY) {
+    fpu_save(&p->fp);
+    set_fs(SSTATUS_FS_CLEAN);
+  }
+  lock::pop_off();
+}
+
+// exec starts over with the unit off and zeroed state
+auto reset(struct proc::process *p) -> void {
+  lock::push_off();
+  set_fs(SSTATUS_FS_OFF);
+  p->fp = {};
+  p->fp_used = false;
+  p->fp_cpu = proc::NCPU;
+  lock::pop_off();
+}
+}  // namespace fpu
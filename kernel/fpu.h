@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+
+namespace proc {
+struct process;
+}  // namespace proc
+
+namespace fpu {
+// lazy floating-point switching driven by sstatus.FS. a process runs
+// with the unit off until its first fp instruction traps, and its
+// registers are only saved when it leaves a hart dirty.
+auto switch_in(struct proc::process *p) -> void;
+auto switch_out(struct proc::process *p) -> void;
+auto trap(struct proc::process *p) -> bool;
+auto flush(struct proc::process *p) -> void;
+auto reset(struct proc::process *p) -> void;
+}  // namespace fpu
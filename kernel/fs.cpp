@@ -75,7 +75,7 @@ auto bfree(uint32_t dev, uint32_t b) {
 }
 
 struct {
-  class lock::spinlock lock{};
+  class lock::spinlock lock{"itable", lock::kind::TICKET};
   struct file::inode inode[fs::NINODE];
 } itable;
 
@@ -486,7 +486,10 @@ auto namex(char *path, bool nameiparent, char *name) -> struct file::inode * {
   if (path != nullptr && *path == '/') {
     ip = iget(ROOTDEV, ROOTINO);
   } else {
-    ip = idup(proc::curr_proc()->cwd);
+    auto *g = proc::curr_proc()->group;
+    g->lock.acquire();
+    ip = idup(g->cwd);
+    g->lock.release();
   }
 
   while ((path = skipelem(path, name)) != nullptr) {
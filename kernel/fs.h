@@ -28,4 +28,5 @@ auto dir_link(struct file::inode *dp, char *name, uint32_t inum) -> int;
 auto dir_link(struct file::inode *dp, char *name, struct file::inode *other)
     -> int;
 auto itrunc(struct file::inode *ip) -> void;
+auto bmap(struct file::inode *ip, uint32_t bn) -> uint32_t;
 }  // namespace fs
@@ -0,0 +1,119 @@
+#include "futex.h"
+
+#include <cstdint>
+
+#ifndef ARCH_RISCV
+#include "arch/riscv.h"
+#define ARCH_RISCV
+#endif
+
+#include "file.h"
+#include "lock.h"
+#include "proc.h"
+#include "vm.h"
+
+namespace futex {
+// futexes are private to a process, waiters are keyed by the page
+// table its threads share and the user address of the word. a physical
+// address would move under them when a store breaks copy-on-write.
+// waiters live on the kernel stack of the waiting thread.
+constexpr uint32_t FUTEX_BITS{6};
+
+struct waiter {
+  uint64_t *pagetable;
+  uint64_t uaddr;
+  struct proc::process *proc;
+  bool woken;
+  struct waiter *next;
+};
+
+struct bucket {
+  class lock::spinlock lock{"futex"};
+  struct waiter *head;
+};
+struct bucket buckets[1U << FUTEX_BITS];
+
+static inline auto bucket_of(uint64_t *pagetable, uint64_t uaddr)
+    -> struct bucket & {
+  auto key = (uint64_t)pagetable ^ uaddr;
+  return buckets[(key * 0x9E3779B97F4A7C15ULL) >> (64 - FUTEX_BITS)];
+}
+
+// where the word at uaddr is right now, 0 when uaddr is not a mapped,
+// aligned user word
+auto word_of(uint64_t *pagetable, uint64_t uaddr) -> uint64_t {
+  if (uaddr % sizeof(uint32_t) != 0) {
+    return 0;
+  }
+  auto pa = vm::walkaddr(pagetable, PG_ROUND_DOWN(uaddr));
+  if (pa == 0) {
+    return 0;
+  }
+  return pa + (uaddr - PG_ROUND_DOWN(uaddr));
+}
+
+// sleep while the word at uaddr still holds val
+auto wait(uint64_t *pagetable, uint64_t uaddr, uint32_t val) -> int {
+  auto &b = bucket_of(pagetable, uaddr);
+  struct waiter w{pagetable, uaddr, proc::curr_proc(), false, nullptr};
+
+  b.lock.acquire();
+  // checked under the bucket lock, a wake after the user changed the
+  // word cannot slip in between
+  auto pa = word_of(pagetable, uaddr);
+  if (pa == 0) {
+    b.lock.release();
+    return -1;
+  }
+  if (__atomic_load_n((uint32_t *)pa, __ATOMIC_ACQUIRE) != val) {
+    b.lock.release();
+    return -file::EAGAIN;
+  }
+  w.next = b.head;
+  b.head = &w;
+
+  auto rs{0};
+  while (!w.woken) {
+    if (proc::get_killed(w.proc)) {
+      rs = -1;
+      break;
+    }
+    proc::sleep(&w, b.lock);
+  }
+  if (!w.woken) {
+    for (auto **pp = &b.head; *pp != nullptr; pp = &(*pp)->next) {
+      if (*pp == &w) {
+        *pp = w.next;
+        break;
+      }
+    }
+  }
+  b.lock.release();
+  return rs;
+}
+
+// wake up to n waiters on uaddr, returns how many were woken
+auto wake(uint64_t *pagetable, uint64_t uaddr, uint32_t n) -> int {
+  if (word_of(pagetable, uaddr) == 0) {
+    return -1;
+  }
+  auto &b = bucket_of(pagetable, uaddr);
+  auto rs{0};
+
+  b.lock.acquire();
+  for (auto **pp = &b.head; *pp != nullptr && n > 0;) {
+    auto *w = *pp;
+    if (w->pagetable != pagetable || w->uaddr != uaddr) {
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = true;
+    proc::wakeup_proc(w->proc, w);
+    --n;
+    ++rs;
+  }
+  b.lock.release();
+  return rs;
+}
+}  // namespace futex
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+
+namespace futex {
+constexpr int FUTEX_WAIT{0};
+constexpr int FUTEX_WAKE{1};
+
+auto wait(uint64_t *pagetable, uint64_t uaddr, uint32_t val) -> int;
+auto wake(uint64_t *pagetable, uint64_t uaddr, uint32_t n) -> int;
+}  // namespace futex
@@ -0,0 +1,62 @@
+#include "ipi.h"
+
+#include <cstdint>
+
+#ifndef ARCH_RISCV
+#include "arch/riscv.h"
+#define ARCH_RISCV
+#endif
+
+#include "lock.h"
+#include "proc.h"
+#include "sched.h"
+#include "vm.h"
+
+namespace ipi {
+uint32_t pending[proc::NCPU];
+
+// raise a software interrupt on cpu. the write to its clint msip word
+// traps into machinevec there, which forwards it as ssip.
+auto send(uint32_t cpu, uint32_t reason) -> void {
+  __atomic_fetch_or(&pending[cpu], reason, __ATOMIC_RELEASE);
+  __sync_synchronize();
+  *(volatile uint32_t *)vm::clint_msip(cpu) = 1;
+}
+
+// supervisor software interrupt, interrupts are off.
+auto handle() -> void {
+  w_sip(r_sip() & ~SIP_SSIP);
+  auto id = proc::cpuid();
+  auto reason = __atomic_load_n(&pending[id], __ATOMIC_ACQUIRE);
+  if (reason & TLB) {
+    sfence_vma();
+  }
+  // clear after acting on it, tlb_shootdown waits for this
+  __atomic_fetch_and(&pending[id], ~reason, __ATOMIC_RELEASE);
+  // RESCHED needs no work here: the interrupt already got the hart out
+  // of wfi, and the trap return checks sched::need_resched().
+}
+
+// flush the tlb of every hart in mask and wait until they all have.
+// must be called with interrupts on and no spinlock held, otherwise two
+// harts shooting at each other would wait forever.
+auto tlb_shootdown(uint32_t mask) -> void {
+  lock::push_off();
+  auto self = proc::cpuid();
+  sfence_vma();
+  lock::pop_off();
+
+  mask &= sched::online_harts() & ~(1U << self);
+  for (uint32_t i{0}; i < proc::NCPU; ++i) {
+    if (mask & (1U << i)) {
+      send(i, TLB);
+    }
+  }
+  for (uint32_t i{0}; i < proc::NCPU; ++i) {
+    if (mask & (1U << i)) {
+      while (__atomic_load_n(&pending[i], __ATOMIC_ACQUIRE) & TLB) {
+      }
+    }
+  }
+}
+}  // namespace ipi
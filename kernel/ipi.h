@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+namespace ipi {
+// reasons, several may be pending on a hart at once
+constexpr uint32_t RESCHED{1U << 0};  // look at the run queue again
+constexpr uint32_t TLB{1U << 1};      // flush the tlb
+
+auto send(uint32_t cpu, uint32_t reason) -> void;
+auto handle() -> void;
+auto tlb_shootdown(uint32_t mask) -> void;
+}  // namespace ipi
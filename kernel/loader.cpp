@@ -6,9 +6,11 @@
 #include "arch/riscv.h"
 #include "elf.h"
 #include "file.h"
+#include "fpu.h"
 #include "fs.h"
 #include "log.h"
 #include "proc.h"
+#include "uring.h"
 #include "vm.h"
 
 namespace loader {
@@ -70,6 +72,12 @@ auto exec(struct file::inode *ip, char *path, char **argv) -> int {
 
   log::begin_op();
 
+  // other threads would be left running on the old image
+  if (p->group->ref > 1) {
+    fail_work(pagetable, ip, sz);
+    return -1;
+  }
+
   if (fs::readi(ip, false, (uint64_t)&elf, 0, sizeof(elf)) != sizeof(elf)) {
     fail_work(pagetable, ip, sz);
     return -1;
@@ -123,7 +131,7 @@ auto exec(struct file::inode *ip, char *path, char **argv) -> int {
   ip = nullptr;
 
   p = proc::curr_proc();
-  uint64_t oldsz = p->sz;
+  uint64_t oldsz = p->group->sz;
 
   sz = PG_ROUND_UP(sz);
   uint64_t sz1 = vm::uvm_alloc(
@@ -173,6 +181,11 @@ auto exec(struct file::inode *ip, char *path, char **argv) -> int {
     return -1;
   }
 
+  // nothing of the old image's registers survives, in particular not
+  // tp, which ulibc takes for a struct pthread pointer when it is set.
+  auto *tf = p->trapframe;
+  std::memset(&tf->ra, 0, (char *)(tf + 1) - (char *)&tf->ra);
+
   // arguments to user main(argc, argv)
   // argc is returned via the system call return
   // value, which goes in a0.
@@ -189,10 +202,13 @@ auto exec(struct file::inode *ip, char *path, char **argv) -> int {
   // Commit to the user image.
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
-  p->sz = sz;
+  p->group->sz = sz;
   p->trapframe->epc = elf.entry;
   p->trapframe->sp = sp;
   proc::free_pagetable(oldpagetable, oldsz);
+  // the new image starts without a ring
+  uring::release(*p->group);
+  fpu::reset(p);
 
   // clang-format off
   return static_cast<int>(argc);  // this ends up in a0, the first argument to main(argc, argv)
@@ -5,13 +5,102 @@
 #define ARCH_RISCV
 #endif
 
+#include <cstring>
 #include <fmt>
 
 #include "proc.h"
+#include "vm.h"
 
 namespace lock {
+constexpr uint32_t BACKOFF_MIN{4};
+constexpr uint32_t BACKOFF_MAX{1024};
+// per ticket ahead of us, roughly one short critical section
+constexpr uint32_t BACKOFF_TICKET{64};
+// mcs locks one hart may hold at once
+constexpr uint32_t NMCS{8};
 
-auto spinlock::holding() -> bool { return locked && cpu == proc::curr_cpu(); }
+struct alignas(64) mcs_slot {
+  struct mcs_node node;
+};
+struct mcs_slot mcs_nodes[proc::NCPU][NMCS];
+uint32_t mcs_used[proc::NCPU];
+
+static inline auto delay(uint32_t n) -> void {
+  for (uint32_t i{0}; i < n; ++i) {
+    asm volatile("nop");
+  }
+}
+
+#ifdef LOCKSTAT
+struct stats *stats_list;
+
+// both run with the lock held, start is when the caller began to wait
+static auto note_acquire(struct stats &st, const char *name, uint32_t kind,
+                         uint64_t start, bool contended) -> void {
+  if (name == nullptr) {
+    return;
+  }
+  if (!st.listed) {
+    st.listed = true;
+    st.name = name;
+    st.kind = kind;
+    st.next = __atomic_load_n(&stats_list, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&stats_list, &st.next, &st, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      ;
+    }
+  }
+  auto now = r_time();
+  ++st.acquired;
+  if (contended) {
+    ++st.contended;
+    st.wait += now - start;
+  }
+  st.hold_start = now;
+}
+
+static auto note_release(struct stats &st, const char *name) -> void {
+  if (name == nullptr) {
+    return;
+  }
+  auto held = r_time() - st.hold_start;
+  if (held > st.max_hold) {
+    st.max_hold = held;
+  }
+}
+#endif
+
+// copy up to n records to addr, returns how many named locks there are
+auto export_stats(uint64_t *pagetable, uint64_t addr, uint32_t n) -> int {
+#ifdef LOCKSTAT
+  uint32_t count{0};
+  for (auto *st = __atomic_load_n(&stats_list, __ATOMIC_ACQUIRE);
+       st != nullptr; st = st->next, ++count) {
+    if (count >= n) {
+      continue;
+    }
+    struct lockstat rec {};
+    std::strncpy(rec.name, st->name, LOCKSTAT_NAME - 1);
+    rec.kind = st->kind;
+    rec.acquired = st->acquired;
+    rec.contended = st->contended;
+    rec.wait = st->wait;
+    rec.max_hold = st->max_hold;
+    if (!vm::copyout(pagetable, addr + count * sizeof(rec), (char *)&rec,
+                     sizeof(rec))) {
+      return -1;
+    }
+  }
+  return static_cast<int>(count);
+#else
+  (void)pagetable;
+  (void)addr;
+  (void)n;
+  return -1;
+#endif
+}
+
+auto spinlock::holding() -> bool { return cpu == proc::curr_cpu(); }
 
 auto push_off() -> void {
   auto old = intr_get();
@@ -37,45 +126,166 @@ auto pop_off() -> void {
   }
 }
 
+// spin on a plain load and only retry the swap once the lock looks
+// free, so waiters do not keep stealing the cache line from the holder.
+// each returns whether it had to wait
+auto spinlock::acquire_tas() -> bool {
+  auto backoff = BACKOFF_MIN;
+  auto waited{false};
+  while (__sync_lock_test_and_set(&locked, true) != false) {
+    waited = true;
+    while (__atomic_load_n(&locked, __ATOMIC_RELAXED)) {
+      delay(backoff);
+      backoff = backoff < BACKOFF_MAX ? backoff * 2 : BACKOFF_MAX;
+    }
+  }
+  __sync_synchronize();
+  return waited;
+}
+
+auto spinlock::acquire_ticket() -> bool {
+  auto me = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED);
+  auto waited{false};
+  while (true) {
+    auto serving = __atomic_load_n(&owner, __ATOMIC_ACQUIRE);
+    if (serving == me) {
+      break;
+    }
+    waited = true;
+    auto ahead = me - serving;
+    delay(ahead * BACKOFF_TICKET < BACKOFF_MAX ? ahead * BACKOFF_TICKET
+                                                : BACKOFF_MAX);
+  }
+  return waited;
+}
+
+// interrupts are off, so the per-hart nodes need no lock
+auto spinlock::acquire_mcs() -> bool {
+  auto id = proc::cpuid();
+  if (mcs_used[id] == (1U << NMCS) - 1) {
+    fmt::panic("lock::acquire: out of mcs nodes");
+  }
+  auto slot = static_cast<uint32_t>(__builtin_ctz(~mcs_used[id]));
+  mcs_used[id] |= 1U << slot;
+  auto *me = &mcs_nodes[id][slot].node;
+  me->next = nullptr;
+  me->locked = true;
+
+  auto *prev = __atomic_exchange_n(&tail, me, __ATOMIC_ACQ_REL);
+  if (prev != nullptr) {
+    __atomic_store_n(&prev->next, me, __ATOMIC_RELEASE);
+    auto backoff = BACKOFF_MIN;
+    while (__atomic_load_n(&me->locked, __ATOMIC_ACQUIRE)) {
+      delay(backoff);
+      backoff = backoff < BACKOFF_MAX / 16 ? backoff * 2 : BACKOFF_MAX / 16;
+    }
+  }
+  node = me;
+  return prev != nullptr;
+}
+
+auto spinlock::release_mcs() -> void {
+  auto *me = node;
+  node = nullptr;
+  auto *succ = __atomic_load_n(&me->next, __ATOMIC_ACQUIRE);
+  if (succ == nullptr) {
+    auto *expected = me;
+    if (!__atomic_compare_exchange_n(&tail, &expected, nullptr, false,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      // a waiter swapped itself in but has not linked up yet
+      while ((succ = __atomic_load_n(&me->next, __ATOMIC_ACQUIRE)) ==
+             nullptr) {
+        ;
+      }
+    }
+  }
+  if (succ != nullptr) {
+    __atomic_store_n(&succ->locked, false, __ATOMIC_RELEASE);
+  }
+
+  auto id = proc::cpuid();
+  mcs_used[id] &= ~(1U << static_cast<uint32_t>(
+                         (struct mcs_slot *)me - mcs_nodes[id]));
+}
+
 auto spinlock::acquire() -> void {
   push_off();
   if (holding()) {
     fmt::panic("lock::acquire: already holding the lock");
   }
-  while (__sync_lock_test_and_set(&locked, true) != false) {
-    ;
+#ifdef LOCKSTAT
+  auto start = r_time();
+#endif
+  [[maybe_unused]] auto contended{false};
+  switch (type) {
+    case kind::TAS:
+      contended = acquire_tas();
+      break;
+    case kind::TICKET:
+      contended = acquire_ticket();
+      break;
+    case kind::MCS:
+      contended = acquire_mcs();
+      break;
   }
-  __sync_synchronize();
 
   cpu = proc::curr_cpu();
+#ifdef LOCKSTAT
+  note_acquire(st, name, static_cast<uint32_t>(type), start, contended);
+#endif
 }
 
 auto spinlock::release() -> void {
   if (holding() == false) {
     fmt::panic("lock::release: no lock");
   }
+#ifdef LOCKSTAT
+  note_release(st, name);
+#endif
 
   cpu = nullptr;
 
-  __sync_synchronize();
-
-  __sync_lock_release(&locked);
+  switch (type) {
+    case kind::TAS:
+      __sync_synchronize();
+      __sync_lock_release(&locked);
+      break;
+    case kind::TICKET:
+      __atomic_store_n(&owner, owner + 1, __ATOMIC_RELEASE);
+      break;
+    case kind::MCS:
+      release_mcs();
+      break;
+  }
 
   pop_off();
 }
 
 auto sleeplock::acquire() -> void {
+#ifdef LOCKSTAT
+  auto start = r_time();
+  auto contended{false};
+#endif
   lk.acquire();
   while (locked) {
+#ifdef LOCKSTAT
+    contended = true;
+#endif
     proc::sleep(this, lk);
   }
   locked = true;
   pid = proc::curr_proc()->pid;
+#ifdef LOCKSTAT
+  note_acquire(st, name, LOCKSTAT_SLEEP, start, contended);
+#endif
   lk.release();
 }
 
 auto sleeplock::release() -> void {
   lk.acquire();
+#ifdef LOCKSTAT
+  note_release(st, name);
+#endif
   locked = false;
   pid = 0;
   proc::wakeup(this);
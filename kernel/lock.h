@@ -6,13 +6,77 @@ struct cpu;
 }  // namespace proc
 
 namespace lock {
+// how a spinlock hands itself over. TAS is test-and-test-and-set with
+// exponential backoff and no fairness. TICKET serves waiters in arrival
+// order, each backing off in proportion to its place in the line. MCS
+// is also FIFO, every waiter spins on its own per-hart queue node and
+// the holder hands over by writing to the next one only.
+enum class kind : uint8_t { TAS, TICKET, MCS };
+
+struct mcs_node {
+  struct mcs_node *next;
+  bool locked;
+};
+
+// record of one named lock as returned by the lockstat syscall, ulibc
+// mirrors it in include/sys/lockstat.h. times are r_time() cycles.
+constexpr uint32_t LOCKSTAT_NAME{16};
+constexpr uint32_t LOCKSTAT_SLEEP{3};  // kind of a sleeplock record
+struct lockstat {
+  char name[LOCKSTAT_NAME];
+  uint32_t kind;
+  uint32_t pad;
+  uint64_t acquired;
+  uint64_t contended;  // acquisitions that had to wait
+  uint64_t wait;       // spent spinning or sleeping for it
+  uint64_t max_hold;
+};
+
+#ifdef LOCKSTAT
+// counters of a named lock, only updated by its holder. a lock is put on
+// the export list the first time it is taken and stays there, so only
+// name locks that are never freed.
+struct stats {
+  const char *name;
+  uint32_t kind;
+  bool listed;
+  uint64_t acquired;
+  uint64_t contended;
+  uint64_t wait;
+  uint64_t max_hold;
+  uint64_t hold_start;
+  struct stats *next;
+};
+#endif
+
+auto export_stats(uint64_t *pagetable, uint64_t addr, uint32_t n) -> int;
+
 class spinlock {
+  enum kind type { kind::TAS };
+  const char *name{nullptr};
+#ifdef LOCKSTAT
+  struct stats st {};
+#endif
   bool locked{false};
+  uint32_t next{0};   // ticket to hand out
+  uint32_t owner{0};  // ticket being served
+  struct mcs_node *tail{nullptr};
+  struct mcs_node *node{nullptr};  // the holder's queue node
 
   struct proc::cpu *cpu{nullptr};
 
+  auto acquire_tas() -> bool;
+  auto acquire_ticket() -> bool;
+  auto acquire_mcs() -> bool;
+  auto release_mcs() -> void;
+
  public:
   spinlock() = default;
+  constexpr explicit spinlock(const char *name, enum kind k = kind::TAS)
+      : type{k}, name{name} {}
+
+  // for locks in memory that skipped the constructor
+  auto set_name(const char *n) -> void { name = n; }
 
   auto acquire() -> void;
   auto release() -> void;
@@ -26,11 +90,16 @@ auto pop_off() -> void;
 class sleeplock {
   bool locked{false};
   class spinlock lk{};
+  const char *name{nullptr};
+#ifdef LOCKSTAT
+  struct stats st {};
+#endif
 
   uint32_t pid{0};
 
  public:
   sleeplock() = default;
+  constexpr explicit sleeplock(const char *name) : name{name} {}
 
   auto acquire() -> void;
   auto release() -> void;
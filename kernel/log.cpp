@@ -15,7 +15,7 @@ struct logheader {
 };
 
 struct log {
-  class lock::spinlock lock{};
+  class lock::spinlock lock{"log"};
   uint32_t start;
   uint32_t size;
   uint32_t outstanding;  // how many FS sys calls are executing.
@@ -12,13 +12,17 @@
 #include "fs.h"
 #include "plic.h"
 #include "proc.h"
+#include "timer.h"
 #include "trap.h"
 #include "virtio_disk.h"
 #include "vm.h"
 
 __attribute__((aligned(16))) volatile unsigned char stack0[4096 * proc::NCPU];
 volatile static bool started{false};
+// per hart scratch for machinevec: a saved register, the msip address
+uint64_t mscratch0[proc::NCPU][2];
 
+extern "C" auto machinevec() -> void;
 auto main() -> void;
 
 auto timerinit() -> void {
@@ -28,6 +32,16 @@ auto timerinit() -> void {
   w_stimecmp(r_time() + 1000000U);
 }
 
+// software interrupts sent through the clint arrive in m-mode,
+// machinevec passes them on to s-mode.
+auto ipiinit() -> void {
+  auto id = r_mhartid();
+  mscratch0[id][1] = vm::clint_msip(id);
+  w_mscratch((uint64_t)&mscratch0[id][0]);
+  w_mtvec((uint64_t)machinevec);
+  w_mie(r_mie() | MIE_MSIE);
+}
+
 extern "C" void start() {
   auto mstatus = r_mstatus();
   mstatus &= ~MSTATUS_MPP_MASK;
@@ -47,6 +61,7 @@ extern "C" void start() {
   w_pmpcfg0(0xf);
 
   timerinit();
+  ipiinit();
 
   auto id = r_mhartid();
   w_tp(id);
@@ -66,6 +81,7 @@ auto main() -> void {
     proc::init();
     fmt::print_log(fmt::log_level::INFO, "proc init successful\n");
     trap::inithart();
+    timer::init();
     plic::init();
     plic::inithart();
     bio::init();
@@ -1,6 +1,7 @@
 #include "pipe.h"
 
 #include <cstdint>
+#include <cstring>
 
 #include "file.h"
 #include "lock.h"
@@ -8,6 +9,26 @@
 #include "vm.h"
 
 namespace file {
+auto free_pages(char **page, uint32_t n) -> void {
+  for (uint32_t i{0}; i < n; ++i) {
+    if (page[i] != nullptr) {
+      vm::kfree(page[i]);
+    }
+  }
+}
+
+auto alloc_pages(char **page, uint32_t n) -> bool {
+  for (uint32_t i{0}; i < n; ++i) {
+    auto opt_page = vm::kalloc();
+    if (!opt_page.has_value()) {
+      free_pages(page, i);
+      return false;
+    }
+    page[i] = (char *)opt_page.value();
+  }
+  return true;
+}
+
 auto pipealloc(struct file **f0, struct file **f1) -> int {
   struct pipe *pi = nullptr;
 
@@ -16,9 +37,16 @@ auto pipealloc(struct file **f0, struct file **f1) -> int {
   if ((*f0 = alloc()) == nullptr || (*f1 = alloc()) == nullptr) {
     goto bad;
   }
-  if ((pi = (struct pipe *)(alloc())) == nullptr) {
+  if (auto opt_pi = vm::kalloc(); opt_pi.has_value()) {
+    pi = (struct pipe *)opt_pi.value();
+  } else {
+    goto bad;
+  }
+  std::memset(pi, 0, sizeof(*pi));
+  if (alloc_pages(pi->page, PIPESIZE / PGSIZE) == false) {
     goto bad;
   }
+  pi->size = PIPESIZE;
   pi->readopen = true;
   pi->writeopen = true;
   pi->nwrite = 0;
@@ -52,19 +80,39 @@ auto pipeclose(struct pipe *pi, bool writable) -> void {
   if (writable) {
     pi->writeopen = false;
     proc::wakeup(&pi->nread);
+    poll::notify(pi->wq, poll::POLLHUP);
   } else {
     pi->readopen = false;
     proc::wakeup(&pi->nwrite);
+    poll::notify(pi->wq, poll::POLLERR);
   }
   if (pi->readopen == false && pi->writeopen == false) {
     pi->lock.release();
+    free_pages(pi->page, pi->size / PGSIZE);
+    for (auto g = pi->ghead; g != pi->gtail; ++g) {
+      vm::kfree((void *)pi->gift[g % PIPE_MAX_GIFTS].pa);
+    }
     vm::kfree(pi);
   } else {
     pi->lock.release();
   }
 }
 
-auto pipewrite(struct pipe *pi, uint64_t addr, int n) -> uint32_t {
+// a writer sleeps only on a full ring and is woken once this much
+// space is free again, not for every byte the reader takes.
+static inline auto wmark(struct pipe *pi) -> uint32_t { return pi->size / 4; }
+
+// pointer to ring position off and how many bytes follow it before
+// the end of its page.
+static inline auto ring_at(struct pipe *pi, uint32_t off, uint32_t &room)
+    -> char * {
+  auto pos = off & (pi->size - 1);
+  room = PGSIZE - pos % PGSIZE;
+  return pi->page[pos / PGSIZE] + pos % PGSIZE;
+}
+
+auto pipewrite(struct pipe *pi, bool user_src, uint64_t addr, int n,
+               bool nonblock) -> uint32_t {
   int i = 0;
   auto *pr = proc::curr_proc();
 
@@ -74,48 +122,236 @@ auto pipewrite(struct pipe *pi, uint64_t addr, int n) -> uint32_t {
       pi->lock.release();
       return -1;
     }
-    if (pi->nwrite == pi->nread + PIPESIZE) {  // DOC: pipewrite-full
-      proc::wakeup(&pi->nread);
-      proc::sleep(&pi->nwrite, pi->lock);
-    } else {
-      char ch = 0;
-      if (vm::copyin(pr->pagetable, &ch, addr + i, 1) == false) {
+    auto used = pi->nwrite - pi->nread;
+    if (used == pi->size) {  // DOC: pipewrite-full
+      if (nonblock) {
+        if (i == 0) {
+          i = -EAGAIN;
+        }
         break;
       }
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      proc::sleep(&pi->nwrite, pi->lock);
+      continue;
+    }
+
+    // one contiguous chunk, up to the end of the free space, the
+    // caller's data or the current ring page.
+    uint32_t room = 0;
+    auto *dst = ring_at(pi, pi->nwrite, room);
+    auto m = static_cast<uint32_t>(n - i);
+    if (m > pi->size - used) {
+      m = pi->size - used;
+    }
+    if (m > room) {
+      m = room;
+    }
+    if (proc::either_copyin(dst, user_src, addr + i, m) == -1) {
+      break;
+    }
+    pi->nwrite += m;
+    i += static_cast<int>(m);
+
+    // a reader only sleeps on an empty ring, wake it on the edge.
+    if (used == 0) {
+      proc::wakeup(&pi->nread);
+      poll::notify(pi->wq, poll::POLLIN);
     }
   }
-  proc::wakeup(&pi->nread);
   pi->lock.release();
 
   return i;
 }
 
-auto piperead(struct pipe *pi, uint64_t addr, int n) -> uint32_t {
+auto piperead(struct pipe *pi, bool user_dst, uint64_t addr, int n,
+              bool nonblock) -> uint32_t {
   int i = 0;
   auto *pr = proc::curr_proc();
-  char ch = 0;
 
   pi->lock.acquire();
-  while (pi->nread == pi->nwrite && pi->writeopen) {  // DOC: pipe-empty
+  while (pi->nread == pi->nwrite && pi->ghead == pi->gtail &&
+         pi->writeopen) {  // DOC: pipe-empty
     if (proc::get_killed(pr)) {
       pi->lock.release();
       return -1;
     }
+    if (nonblock) {
+      pi->lock.release();
+      return -EAGAIN;
+    }
     proc::sleep(&pi->nread, pi->lock);  // DOC: piperead-sleep
   }
-  for (i = 0; i < n; i++) {  // DOC: piperead-copy
-    if (pi->nread == pi->nwrite) {
+
+  auto before = pi->size - (pi->nwrite - pi->nread);
+  while (i < n) {  // DOC: piperead-copy
+    // ring bytes up to the next gift, then the gift itself.
+    auto avail = pi->nwrite - pi->nread;
+    if (pi->ghead != pi->gtail) {
+      auto &g = pi->gift[pi->ghead % PIPE_MAX_GIFTS];
+      if (g.at == pi->nread) {
+        auto m = static_cast<uint32_t>(n - i);
+        if (m > PGSIZE - g.off) {
+          m = PGSIZE - g.off;
+        }
+        if (proc::either_copyout(user_dst, addr + i, (char *)g.pa + g.off,
+                                 m) == -1) {
+          break;
+        }
+        g.off += m;
+        i += static_cast<int>(m);
+        if (g.off == PGSIZE) {
+          vm::kfree((void *)g.pa);
+          if (pi->gtail - pi->ghead++ == PIPE_MAX_GIFTS) {
+            proc::wakeup(&pi->nwrite);
+          }
+        }
+        continue;
+      }
+      avail = g.at - pi->nread;
+    }
+    if (avail == 0) {
       break;
     }
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if (vm::copyout(pr->pagetable, addr + i, &ch, 1) == false) {
+
+    uint32_t room = 0;
+    auto *src = ring_at(pi, pi->nread, room);
+    auto m = static_cast<uint32_t>(n - i);
+    if (m > avail) {
+      m = avail;
+    }
+    if (m > room) {
+      m = room;
+    }
+    if (proc::either_copyout(user_dst, addr + i, src, m) == -1) {
       break;
     }
+    pi->nread += m;
+    i += static_cast<int>(m);
+  }
+
+  auto after = pi->size - (pi->nwrite - pi->nread);
+  if (before < wmark(pi) && after >= wmark(pi)) {
+    proc::wakeup(&pi->nwrite);
+    poll::notify(pi->wq, poll::POLLOUT);
   }
-  proc::wakeup(&pi->nwrite);
   pi->lock.release();
   return i;
 }
+
+// queue the user page at va after everything written so far. the
+// page is shared copy-on-write, so the reader copies it once and the
+// writer may keep using its buffer.
+auto pipegift(struct pipe *pi, uint64_t va, bool nonblock) -> int {
+  auto *pr = proc::curr_proc();
+
+  pi->lock.acquire();
+  while (pi->gtail - pi->ghead == PIPE_MAX_GIFTS) {
+    if (pi->readopen == false || proc::get_killed(pr)) {
+      pi->lock.release();
+      return -1;
+    }
+    if (nonblock) {
+      pi->lock.release();
+      return -EAGAIN;
+    }
+    proc::sleep(&pi->nwrite, pi->lock);
+  }
+  if (pi->readopen == false) {
+    pi->lock.release();
+    return -1;
+  }
+
+  auto pa = vm::gift_page(pr->pagetable, va);
+  if (pa == 0) {
+    pi->lock.release();
+    return -1;
+  }
+  auto empty = pi->nread == pi->nwrite && pi->ghead == pi->gtail;
+  pi->gift[pi->gtail % PIPE_MAX_GIFTS] = {pa, 0, pi->nwrite};
+  ++pi->gtail;
+  if (empty) {
+    proc::wakeup(&pi->nread);
+    poll::notify(pi->wq, poll::POLLIN);
+  }
+  pi->lock.release();
+  return PGSIZE;
+}
+
+auto pipepoll(struct pipe *pi) -> uint32_t {
+  uint32_t mask{0};
+  pi->lock.acquire();
+  if (pi->nread != pi->nwrite || pi->ghead != pi->gtail) {
+    mask |= poll::POLLIN;
+  }
+  if (pi->writeopen == false) {
+    mask |= poll::POLLHUP;
+  }
+  // report writable on the same watermark readers wake writers at,
+  // a poller never waits for a notification that won't come.
+  if (pi->size - (pi->nwrite - pi->nread) >= wmark(pi)) {
+    mask |= poll::POLLOUT;
+  }
+  if (pi->readopen == false) {
+    mask |= poll::POLLERR;
+  }
+  pi->lock.release();
+  return mask;
+}
+
+// F_SETPIPE_SZ, size is rounded up to a power of two number of pages
+// and must still hold what is buffered right now.
+auto piperesize(struct pipe *pi, uint32_t size) -> int {
+  if (size > PIPE_MAX_PAGES * PGSIZE) {
+    return -1;
+  }
+  uint32_t npages{1};
+  while (npages * PGSIZE < size) {
+    npages <<= 1U;
+  }
+
+  char *page[PIPE_MAX_PAGES]{};
+  if (alloc_pages(page, npages) == false) {
+    return -1;
+  }
+
+  pi->lock.acquire();
+  auto used = pi->nwrite - pi->nread;
+  if (used > npages * PGSIZE) {
+    pi->lock.release();
+    free_pages(page, npages);
+    return -1;
+  }
+  // linearise the buffered bytes at the start of the new ring.
+  for (uint32_t done{0}; done < used;) {
+    uint32_t room = 0;
+    auto *src = ring_at(pi, pi->nread + done, room);
+    auto m = used - done < room ? used - done : room;
+    if (m > PGSIZE - done % PGSIZE) {
+      m = PGSIZE - done % PGSIZE;
+    }
+    std::memmove(page[done / PGSIZE] + done % PGSIZE, src, m);
+    done += m;
+  }
+  auto old_npages = pi->size / PGSIZE;
+  char *old[PIPE_MAX_PAGES]{};
+  for (uint32_t i{0}; i < PIPE_MAX_PAGES; ++i) {
+    old[i] = pi->page[i];
+    pi->page[i] = page[i];
+  }
+  auto grew = npages * PGSIZE > pi->size;
+  size = npages * PGSIZE;
+  pi->size = size;
+  for (auto g = pi->ghead; g != pi->gtail; ++g) {
+    pi->gift[g % PIPE_MAX_GIFTS].at -= pi->nread;
+  }
+  pi->nread = 0;
+  pi->nwrite = used;
+  if (grew) {
+    proc::wakeup(&pi->nwrite);
+    poll::notify(pi->wq, poll::POLLOUT);
+  }
+  pi->lock.release();
+
+  free_pages(old, old_npages);
+  return static_cast<int>(size);
+}
 }  // namespace file
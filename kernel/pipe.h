@@ -1,22 +1,44 @@
 #pragma once
 #include <cstdint>
 
+#include "arch/riscv.h"
 #include "lock.h"
+#include "poll.h"
 
 namespace file {
-constexpr uint32_t PIPESIZE{512};
+constexpr uint32_t PIPESIZE{PGSIZE};  // default ring size
+constexpr uint32_t PIPE_MAX_PAGES{16};
+constexpr uint32_t PIPE_MAX_GIFTS{16};
+
+// a whole user page handed over by vmsplice, it sits in the byte
+// stream right before ring offset at.
+struct gift {
+  uint64_t pa;
+  uint32_t off;  // bytes already read
+  uint32_t at;
+};
 
 struct pipe {
   class lock::spinlock lock{};
-  char data[PIPESIZE];
+  char *page[PIPE_MAX_PAGES];  // ring storage, size / PGSIZE pages
+  uint32_t size;    // ring bytes, a power of two multiple of PGSIZE
   uint32_t nread;   // number of bytes read
   uint32_t nwrite;  // number of bytes written
+  struct gift gift[PIPE_MAX_GIFTS];
+  uint32_t ghead;  // gifts consumed
+  uint32_t gtail;  // gifts queued
   bool readopen;    // read fd is still open
   bool writeopen;   // write fd is still open
+  struct poll::waitq wq{};
 };
 
-auto piperead(struct pipe *pi, uint64_t addr, int n) -> uint32_t;
-auto pipewrite(struct pipe *pi, uint64_t addr, int n) -> uint32_t;
+auto piperead(struct pipe *pi, bool user_dst, uint64_t addr, int n,
+              bool nonblock) -> uint32_t;
+auto pipewrite(struct pipe *pi, bool user_src, uint64_t addr, int n,
+               bool nonblock) -> uint32_t;
+auto pipegift(struct pipe *pi, uint64_t va, bool nonblock) -> int;
+auto pipepoll(struct pipe *pi) -> uint32_t;
+auto piperesize(struct pipe *pi, uint32_t size) -> int;
 auto pipeclose(struct pipe *pi, bool writable) -> void;
 auto pipealloc(struct file **f0, struct file **f1) -> int;
 }  // namespace file
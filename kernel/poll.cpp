@@ -0,0 +1,558 @@
+#include "poll.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "fdtable.h"
+#include "file.h"
+#include "lock.h"
+#include "proc.h"
+#include "timer.h"
+#include "vm.h"
+
+namespace poll {
+auto add(struct waitq &wq, struct entry &e) -> void {
+  wq.lock.acquire();
+  e.wq = &wq;
+  e.prev = nullptr;
+  e.next = wq.head;
+  if (wq.head != nullptr) {
+    wq.head->prev = &e;
+  }
+  wq.head = &e;
+  wq.lock.release();
+}
+
+auto remove(struct entry &e) -> void {
+  if (e.wq == nullptr) {
+    return;
+  }
+  auto &wq = *e.wq;
+  wq.lock.acquire();
+  if (e.prev != nullptr) {
+    e.prev->next = e.next;
+  } else {
+    wq.head = e.next;
+  }
+  if (e.next != nullptr) {
+    e.next->prev = e.prev;
+  }
+  wq.lock.release();
+  e.next = e.prev = nullptr;
+  e.wq = nullptr;
+}
+
+// called by the object with its own lock held, the callbacks must not
+// sleep.
+auto notify(struct waitq &wq, uint32_t events) -> void {
+  wq.lock.acquire();
+  for (auto *e = wq.head; e != nullptr; e = e->next) {
+    e->fn(e, events);
+  }
+  wq.lock.release();
+}
+
+// poll(2)
+
+struct poller {
+  class lock::spinlock lock{};
+  struct proc::process *proc;
+  bool triggered;
+  bool expired;
+};
+
+struct pollslot {
+  struct pollfd pfd;
+  struct entry entry;
+  struct file::file *file;
+};
+
+static_assert(sizeof(struct pollslot) * POLL_MAX <= PGSIZE);
+
+auto poller_callback(struct entry *e, uint32_t /*events*/) -> void {
+  auto *pw = static_cast<struct poller *>(e->priv);
+  pw->lock.acquire();
+  pw->triggered = true;
+  proc::wakeup_proc(pw->proc, pw);
+  pw->lock.release();
+}
+
+auto poller_timeout(void *arg) -> void {
+  auto *pw = static_cast<struct poller *>(arg);
+  pw->lock.acquire();
+  pw->triggered = true;
+  pw->expired = true;
+  proc::wakeup_proc(pw->proc, pw);
+  pw->lock.release();
+}
+
+auto poll(uint64_t ufds, int nfds, int timeout) -> int {
+  if (nfds < 0 || nfds > static_cast<int>(POLL_MAX)) {
+    return -1;
+  }
+  auto opt_page = vm::kalloc();
+  if (!opt_page.has_value()) {
+    return -1;
+  }
+  auto *slots = (struct pollslot *)opt_page.value();
+  std::memset(slots, 0, PGSIZE);
+
+  auto *p = proc::curr_proc();
+  struct poller pw{};
+  pw.proc = p;
+
+  auto rs{0};
+  for (auto i{0}; i < nfds; ++i) {
+    if (vm::copyin(p->pagetable, (char *)&slots[i].pfd,
+                   ufds + i * sizeof(struct pollfd),
+                   sizeof(struct pollfd)) == false) {
+      rs = -1;
+      nfds = i;
+      break;
+    }
+    auto &s = slots[i];
+    s.file = file::fd_get(p->group->fdt, s.pfd.fd);
+    if (s.file == nullptr) {
+      continue;
+    }
+    auto *wq = file::poll_queue(s.file);
+    if (wq != nullptr) {
+      s.entry.fn = poller_callback;
+      s.entry.priv = &pw;
+      add(*wq, s.entry);
+    }
+  }
+
+  struct timer::timer t{};
+  if (rs == 0 && timeout > 0) {
+    t.fn = poller_timeout;
+    t.arg = &pw;
+    timer::add(t, timer::jiffies() + timeout);
+  }
+
+  while (rs == 0) {
+    pw.lock.acquire();
+    pw.triggered = false;
+    pw.lock.release();
+
+    // readiness is sampled without the poller lock, a change after the
+    // sample sets triggered and the sleep below is skipped.
+    auto count{0};
+    for (auto i{0}; i < nfds; ++i) {
+      auto &s = slots[i];
+      s.pfd.revents = 0;
+      if (s.pfd.fd < 0) {
+        continue;
+      }
+      if (s.file == nullptr) {
+        s.pfd.revents = POLLNVAL;
+      } else {
+        auto want = static_cast<uint32_t>(s.pfd.events) | POLLERR | POLLHUP;
+        s.pfd.revents = static_cast<int16_t>(file::poll_mask(s.file) & want);
+      }
+      if (s.pfd.revents != 0) {
+        ++count;
+      }
+    }
+    if (count > 0 || timeout == 0) {
+      rs = count;
+      break;
+    }
+
+    pw.lock.acquire();
+    if (pw.expired) {
+      pw.lock.release();
+      break;
+    }
+    if (proc::get_killed(p)) {
+      pw.lock.release();
+      rs = -1;
+      break;
+    }
+    if (pw.triggered == false) {
+      proc::sleep(&pw, pw.lock);
+    }
+    pw.lock.release();
+  }
+
+  for (auto i{0}; i < nfds; ++i) {
+    remove(slots[i].entry);
+    if (slots[i].file != nullptr) {
+      file::close(slots[i].file);
+    }
+  }
+  timer::del(t);
+
+  for (auto i{0}; rs >= 0 && i < nfds; ++i) {
+    if (vm::copyout(p->pagetable, ufds + i * sizeof(struct pollfd),
+                    (char *)&slots[i].pfd, sizeof(struct pollfd)) == false) {
+      rs = -1;
+    }
+  }
+  vm::kfree(slots);
+  return rs;
+}
+
+// epoll
+
+struct epitem {
+  struct entry entry;
+  struct eventpoll *ep;
+  struct file::file *file;
+  int fd;
+  uint32_t events;
+  uint64_t data;
+  bool ready;
+  struct epitem *next;    // interest list
+  struct epitem *rdnext;  // ready list
+  struct epitem *fnext;   // items watching the same file
+};
+
+struct eventpoll {
+  class lock::spinlock lock{};  // protects the ready list
+  class lock::sleeplock mtx{};  // serialises ctl and the wait scans
+  struct epitem *items;
+  struct epitem *rdhead;
+  struct epitem *rdtail;
+};
+
+constexpr uint32_t EPITEM_PER_PAGE{PGSIZE / sizeof(struct epitem)};
+
+struct {
+  class lock::spinlock lock{};
+  struct epitem *freelist{nullptr};
+} epcache;
+
+// items only borrow their file. flist_lock guards the per-file lists,
+// epmutex keeps an eventpoll alive while a closing file detaches from
+// it, it is taken before any ep->mtx.
+class lock::spinlock flist_lock{"epoll_flist"};
+class lock::sleeplock epmutex{"epmutex"};
+
+auto item_alloc() -> struct epitem * {
+  epcache.lock.acquire();
+  if (epcache.freelist == nullptr) {
+    auto opt_page = vm::kalloc();
+    if (!opt_page.has_value()) {
+      epcache.lock.release();
+      return nullptr;
+    }
+    auto *items = (struct epitem *)opt_page.value();
+    for (uint32_t i{0}; i < EPITEM_PER_PAGE; ++i) {
+      items[i].next = epcache.freelist;
+      epcache.freelist = &items[i];
+    }
+  }
+  auto *it = epcache.freelist;
+  epcache.freelist = it->next;
+  epcache.lock.release();
+
+  std::memset(it, 0, sizeof(*it));
+  return it;
+}
+
+auto item_free(struct epitem *it) -> void {
+  epcache.lock.acquire();
+  it->next = epcache.freelist;
+  epcache.freelist = it;
+  epcache.lock.release();
+}
+
+// ep->lock must be held
+auto queue_ready(struct eventpoll *ep, struct epitem *it) -> void {
+  if (it->ready) {
+    return;
+  }
+  it->ready = true;
+  it->rdnext = nullptr;
+  if (ep->rdtail != nullptr) {
+    ep->rdtail->rdnext = it;
+  } else {
+    ep->rdhead = it;
+  }
+  ep->rdtail = it;
+}
+
+// ep->lock must be held
+auto unqueue_ready(struct eventpoll *ep, struct epitem *it) -> void {
+  if (it->ready == false) {
+    return;
+  }
+  struct epitem *prev{nullptr};
+  for (auto *cur = ep->rdhead; cur != nullptr; prev = cur, cur = cur->rdnext) {
+    if (cur == it) {
+      if (prev != nullptr) {
+        prev->rdnext = cur->rdnext;
+      } else {
+        ep->rdhead = cur->rdnext;
+      }
+      if (ep->rdtail == cur) {
+        ep->rdtail = prev;
+      }
+      break;
+    }
+  }
+  it->ready = false;
+}
+
+auto ep_callback(struct entry *e, uint32_t events) -> void {
+  auto *it = static_cast<struct epitem *>(e->priv);
+  if ((events & (it->events | POLLERR | POLLHUP)) == 0) {
+    return;
+  }
+  auto *ep = it->ep;
+  ep->lock.acquire();
+  queue_ready(ep, it);
+  proc::wakeup(ep);
+  ep->lock.release();
+}
+
+auto check_ready(struct eventpoll *ep, struct epitem *it) -> void {
+  if ((file::poll_mask(it->file) & (it->events | POLLERR | POLLHUP)) != 0) {
+    ep->lock.acquire();
+    queue_ready(ep, it);
+    ep->lock.release();
+  }
+}
+
+auto epoll_create() -> struct file::file * {
+  auto *f = file::alloc();
+  if (f == nullptr) {
+    return nullptr;
+  }
+  auto opt_page = vm::kalloc();
+  if (!opt_page.has_value()) {
+    file::close(f);
+    return nullptr;
+  }
+  auto *ep = (struct eventpoll *)opt_page.value();
+  std::memset(ep, 0, sizeof(*ep));
+
+  f->type = file::file::FD_EPOLL;
+  f->ep = ep;
+  f->readable = false;
+  f->writable = false;
+  return f;
+}
+
+auto find(struct eventpoll *ep, int fd, struct file::file *f)
+    -> struct epitem ** {
+  for (auto **pp = &ep->items; *pp != nullptr; pp = &(*pp)->next) {
+    if ((*pp)->fd == fd && (*pp)->file == f) {
+      return pp;
+    }
+  }
+  return nullptr;
+}
+
+// ep->mtx must be held, it is already off the interest list
+auto detach(struct eventpoll *ep, struct epitem *it) -> void {
+  remove(it->entry);
+  ep->lock.acquire();
+  unqueue_ready(ep, it);
+  ep->lock.release();
+
+  flist_lock.acquire();
+  for (auto **pp = &it->file->epitems; *pp != nullptr; pp = &(*pp)->fnext) {
+    if (*pp == it) {
+      __atomic_store_n(pp, it->fnext, __ATOMIC_RELEASE);
+      break;
+    }
+  }
+  flist_lock.release();
+  item_free(it);
+}
+
+auto epoll_ctl(struct eventpoll *ep, int op, int fd, struct file::file *f,
+               struct epoll_event &ev) -> int {
+  if (f->type == file::file::FD_EPOLL) {
+    return -1;
+  }
+
+  auto rs{0};
+  ep->mtx.acquire();
+  auto **pp = find(ep, fd, f);
+  if (op == EPOLL_CTL_ADD) {
+    auto *it = pp == nullptr ? item_alloc() : nullptr;
+    if (it == nullptr) {
+      rs = -1;
+    } else {
+      it->ep = ep;
+      it->file = f;
+      it->fd = fd;
+      it->events = ev.events;
+      it->data = ev.data;
+      it->next = ep->items;
+      ep->items = it;
+      it->entry.fn = ep_callback;
+      it->entry.priv = it;
+      flist_lock.acquire();
+      it->fnext = f->epitems;
+      __atomic_store_n(&f->epitems, it, __ATOMIC_RELEASE);
+      flist_lock.release();
+      auto *wq = file::poll_queue(f);
+      if (wq != nullptr) {
+        add(*wq, it->entry);
+      }
+      check_ready(ep, it);
+    }
+  } else if (op == EPOLL_CTL_MOD && pp != nullptr) {
+    auto *it = *pp;
+    ep->lock.acquire();
+    it->events = ev.events;
+    it->data = ev.data;
+    ep->lock.release();
+    check_ready(ep, it);
+  } else if (op == EPOLL_CTL_DEL && pp != nullptr) {
+    auto *it = *pp;
+    *pp = it->next;
+    detach(ep, it);
+  } else {
+    rs = -1;
+  }
+  ep->mtx.release();
+  return rs;
+}
+
+struct epwaiter {
+  struct eventpoll *ep;
+  struct proc::process *proc;
+  bool expired;
+};
+
+auto ep_timeout(void *arg) -> void {
+  auto *w = static_cast<struct epwaiter *>(arg);
+  w->ep->lock.acquire();
+  w->expired = true;
+  proc::wakeup_proc(w->proc, w->ep);
+  w->ep->lock.release();
+}
+
+auto epoll_wait(struct eventpoll *ep, uint64_t uevents, int maxevents,
+                int timeout) -> int {
+  if (maxevents <= 0) {
+    return -1;
+  }
+  if (maxevents > static_cast<int>(POLL_MAX)) {
+    maxevents = POLL_MAX;
+  }
+
+  auto *p = proc::curr_proc();
+  struct epwaiter w{ep, p, false};
+  struct timer::timer t{};
+  if (timeout > 0) {
+    t.fn = ep_timeout;
+    t.arg = &w;
+    timer::add(t, timer::jiffies() + timeout);
+  }
+
+  auto count{0};
+  while (true) {
+    struct epitem *batch[POLL_MAX];
+    auto n{0};
+
+    ep->mtx.acquire();
+    ep->lock.acquire();
+    while (n < maxevents && ep->rdhead != nullptr) {
+      auto *it = ep->rdhead;
+      ep->rdhead = it->rdnext;
+      if (ep->rdhead == nullptr) {
+        ep->rdtail = nullptr;
+      }
+      it->ready = false;
+      batch[n++] = it;
+    }
+    ep->lock.release();
+
+    for (auto i{0}; i < n; ++i) {
+      auto *it = batch[i];
+      auto mask = file::poll_mask(it->file) &
+                  (it->events | POLLERR | POLLHUP) & ~EPOLLET;
+      if (mask == 0) {
+        continue;
+      }
+      struct epoll_event ev{mask, it->data};
+      if (count >= 0 &&
+          vm::copyout(p->pagetable,
+                      uevents + count * sizeof(struct epoll_event),
+                      (char *)&ev, sizeof(ev)) == false) {
+        count = -1;
+      } else if (count >= 0) {
+        ++count;
+      }
+      // level triggered items stay queued until they are drained,
+      // edge triggered ones wait for the next notification.
+      if ((it->events & EPOLLET) == 0) {
+        ep->lock.acquire();
+        queue_ready(ep, it);
+        ep->lock.release();
+      }
+    }
+    ep->mtx.release();
+
+    if (count != 0 || timeout == 0) {
+      break;
+    }
+
+    auto stop{false};
+    ep->lock.acquire();
+    if (ep->rdhead == nullptr && w.expired == false &&
+        proc::get_killed(p) == false) {
+      proc::sleep(ep, ep->lock);
+    }
+    if (w.expired) {
+      stop = true;
+    } else if (proc::get_killed(p)) {
+      count = -1;
+      stop = true;
+    }
+    ep->lock.release();
+    if (stop) {
+      break;
+    }
+  }
+
+  timer::del(t);
+  return count;
+}
+
+auto epoll_release(struct eventpoll *ep) -> void {
+  epmutex.acquire();
+  ep->mtx.acquire();
+  while (ep->items != nullptr) {
+    auto *it = ep->items;
+    ep->items = it->next;
+    detach(ep, it);
+  }
+  ep->mtx.release();
+  epmutex.release();
+  vm::kfree(ep);
+}
+
+// the last reference to f is gone, drop it from every set watching it
+// so that closing the file releases it like it does without epoll.
+auto epoll_forget(struct file::file *f) -> void {
+  epmutex.acquire();
+  while (true) {
+    flist_lock.acquire();
+    auto *it = f->epitems;
+    flist_lock.release();
+    if (it == nullptr) {
+      break;
+    }
+    // nobody can add f to a set any more, so the head stays it until
+    // it is detached here
+    auto *ep = it->ep;
+    ep->mtx.acquire();
+    for (auto **pp = &ep->items; *pp != nullptr; pp = &(*pp)->next) {
+      if (*pp == it) {
+        *pp = it->next;
+        break;
+      }
+    }
+    detach(ep, it);
+    ep->mtx.release();
+  }
+  epmutex.release();
+}
+}  // namespace poll
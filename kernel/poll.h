@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+
+#include "lock.h"
+
+namespace file {
+struct file;
+}  // namespace file
+
+namespace poll {
+constexpr uint32_t POLLIN{0x001};
+constexpr uint32_t POLLOUT{0x004};
+constexpr uint32_t POLLERR{0x008};
+constexpr uint32_t POLLHUP{0x010};
+constexpr uint32_t POLLNVAL{0x020};
+
+constexpr uint32_t EPOLLET{1U << 31U};
+
+constexpr int EPOLL_CTL_ADD{1};
+constexpr int EPOLL_CTL_DEL{2};
+constexpr int EPOLL_CTL_MOD{3};
+
+constexpr uint32_t POLL_MAX{64};
+
+struct entry;
+
+// every pollable object owns a waitq, pollers hang an entry on it and
+// get their callback run whenever the object's readiness changes.
+struct waitq {
+  class lock::spinlock lock{};
+  struct entry *head{nullptr};
+};
+
+struct entry {
+  struct entry *next;
+  struct entry *prev;
+  struct waitq *wq;
+  void (*fn)(struct entry *e, uint32_t events);
+  void *priv;
+};
+
+// user layout of poll(2) and epoll_wait(2) arguments
+struct pollfd {
+  int fd;
+  int16_t events;
+  int16_t revents;
+};
+
+struct epoll_event {
+  uint32_t events;
+  uint64_t data;
+};
+
+struct eventpoll;
+
+auto add(struct waitq &wq, struct entry &e) -> void;
+auto remove(struct entry &e) -> void;
+auto notify(struct waitq &wq, uint32_t events) -> void;
+
+auto poll(uint64_t ufds, int nfds, int timeout) -> int;
+auto epoll_create() -> struct file::file *;
+auto epoll_ctl(struct eventpoll *ep, int op, int fd, struct file::file *f,
+               struct epoll_event &ev) -> int;
+auto epoll_wait(struct eventpoll *ep, uint64_t uevents, int maxevents,
+                int timeout) -> int;
+auto epoll_release(struct eventpoll *ep) -> void;
+auto epoll_forget(struct file::file *f) -> void;
+}  // namespace poll
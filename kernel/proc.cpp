@@ -12,9 +12,14 @@
 #endif
 
 #include "file.h"
+#include "fpu.h"
 #include "fs.h"
+#include "futex.h"
+#include "ipi.h"
 #include "lock.h"
 #include "log.h"
+#include "sched.h"
+#include "timer.h"
 #include "trap.h"
 #include "vm.h"
 
@@ -44,7 +49,77 @@ const unsigned char initcode[] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 // clang-format on
 
-struct process proc_list[NPROC];
+// processes and groups are carved out of whole pages that are never
+// given back, so pointers to entries stay valid and a table can be
+// walked without a lock while another hart grows it.
+template <typename T>
+class slab {
+ public:
+  static constexpr uint64_t PER_PAGE{(PGSIZE - sizeof(void *)) / sizeof(T)};
+  static_assert(PER_PAGE > 0);
+
+  struct page {
+    struct page *next;
+    T items[PER_PAGE];
+  };
+
+  class iterator {
+    struct page *pg;
+    uint64_t i;
+
+   public:
+    iterator(struct page *pg, uint64_t i) : pg{pg}, i{i} {}
+    auto operator*() const -> T & { return pg->items[i]; }
+    auto operator++() -> iterator & {
+      if (++i == PER_PAGE) {
+        pg = __atomic_load_n(&pg->next, __ATOMIC_ACQUIRE);
+        i = 0;
+      }
+      return *this;
+    }
+    auto operator!=(const iterator &o) const -> bool {
+      return pg != o.pg || i != o.i;
+    }
+  };
+
+  auto begin() -> iterator {
+    return {__atomic_load_n(&head, __ATOMIC_ACQUIRE), 0};
+  }
+  auto end() -> iterator { return {nullptr, 0}; }
+
+  // append a zeroed page, init sees every new entry with its index in
+  // the table before the page is published. false when out of memory.
+  auto grow(void (*init)(T &, uint64_t)) -> bool {
+    auto opt_page = vm::kalloc();
+    if (!opt_page.has_value()) {
+      return false;
+    }
+    std::memset(opt_page.value(), 0, PGSIZE);
+    auto *pg = (struct page *)opt_page.value();
+
+    lock.acquire();
+    if (init != nullptr) {
+      for (uint64_t i{0}; i < PER_PAGE; i++) {
+        init(pg->items[i], npages * PER_PAGE + i);
+      }
+    }
+    __atomic_store_n(tail == nullptr ? &head : &tail->next, pg,
+                     __ATOMIC_RELEASE);
+    tail = pg;
+    npages++;
+    lock.release();
+    return true;
+  }
+
+ private:
+  struct page *head{};
+  struct page *tail{};
+  uint64_t npages{};
+  class lock::spinlock lock{};
+};
+
+slab<struct process> proc_list;
+slab<struct group> group_list;
 struct process *init_proc{};
 struct cpu cpu_list[NCPU];
 uint32_t next_pid{1};
@@ -54,10 +129,12 @@ struct user_list{
   struct user user;
   bool enable{false};
 };
-std::array<user_list, NPROC> user_list;
+std::array<user_list, NUSER> user_list;
 
-class lock::spinlock wait_lock{};
-class lock::spinlock pid_lock{};
+class lock::spinlock wait_lock{"wait_lock"};
+class lock::spinlock pid_lock{"pid"};
+// every allocated slot by pid, threads included
+struct process *pid_hash[1U << PID_HASH_BITS];
 
 auto forkret() -> void;
 
@@ -72,26 +149,21 @@ auto curr_cpu() -> struct cpu * {
 auto curr_proc() -> struct process * { return curr_cpu()->proc; }
 
 auto init() -> void {
-  for (auto &proc : proc_list) {
-    proc.status = proc_status::UNUSED;
-    proc.kernel_stack =
-        vm::KSTACK((int)((uint64_t)&proc - (uint64_t)&proc_list[0]));
-  }
   root.gid = ROOT_ID;
   root.uid = ROOT_ID;
 }
 
-auto map_stack(uint64_t *kpt) -> void {
-  for (auto &proc : proc_list) {
-    auto opt_pa = vm::kalloc();
-    if (opt_pa.has_value()) {
-      auto *pa = opt_pa.value();
-      auto va = vm::KSTACK((int)((uint64_t)&proc - (uint64_t)proc_list));
-      vm::map_pages(kpt, va, (uint64_t)pa, PGSIZE, PTE_R | PTE_W);
-    } else {
-      fmt::panic("proc::map_stack: error");
-    }
-  }
+// each table entry owns a fixed kernel stack address, the page behind
+// it is only mapped while the entry is in use
+auto init_slot(struct process &p, uint64_t index) -> void {
+  p.lock.set_name("proc");
+  p.status = proc_status::UNUSED;
+  p.kernel_stack = vm::KSTACK(static_cast<int>(index));
+}
+
+auto init_group(struct group &g, uint64_t) -> void {
+  g.lock.set_name("group");
+  g.fdt.lock.set_name("fdtable");
 }
 
 auto alloc_pid() -> uint32_t {
@@ -102,6 +174,56 @@ auto alloc_pid() -> uint32_t {
   return pid;
 }
 
+static inline auto pid_bucket(uint32_t pid) -> struct process ** {
+  return &pid_hash[pid & ((1U << PID_HASH_BITS) - 1)];
+}
+
+auto hash_pid(struct process *p) -> void {
+  pid_lock.acquire();
+  auto **head = pid_bucket(p->pid);
+  p->hash_next = *head;
+  *head = p;
+  pid_lock.release();
+}
+
+auto unhash_pid(struct process *p) -> void {
+  pid_lock.acquire();
+  for (auto **pp = pid_bucket(p->pid); *pp != nullptr;
+       pp = &(*pp)->hash_next) {
+    if (*pp == p) {
+      *pp = p->hash_next;
+      break;
+    }
+  }
+  p->hash_next = nullptr;
+  pid_lock.release();
+}
+
+// child lists are only changed with wait_lock held
+auto link_child(struct process *parent, struct process *child) -> void {
+  child->parent = parent;
+  child->sibling_prev = nullptr;
+  child->sibling_next = parent->children;
+  if (parent->children != nullptr) {
+    parent->children->sibling_prev = child;
+  }
+  parent->children = child;
+}
+
+auto unlink_child(struct process *child) -> void {
+  if (child->sibling_prev != nullptr) {
+    child->sibling_prev->sibling_next = child->sibling_next;
+  } else {
+    child->parent->children = child->sibling_next;
+  }
+  if (child->sibling_next != nullptr) {
+    child->sibling_next->sibling_prev = child->sibling_prev;
+  }
+  child->parent = nullptr;
+  child->sibling_next = nullptr;
+  child->sibling_prev = nullptr;
+}
+
 auto alloc_pagetable(struct process &p) -> uint64_t * {
   auto *uvm = vm::uvm_create();
   if (uvm == nullptr) {
@@ -119,25 +241,58 @@ auto alloc_pagetable(struct process &p) -> uint64_t * {
     vm::uvm_free(uvm, 0);
     return nullptr;
   }
+  if (vm::map_pages(uvm, vm::VDATA, (uint64_t)p.vdata, PGSIZE,
+                    PTE_R | PTE_U) == false) {
+    vm::uvm_unmap(uvm, vm::TRAMPOLINE, 1, false);
+    vm::uvm_unmap(uvm, vm::TRAPFRAME, 1, false);
+    vm::uvm_free(uvm, 0);
+    return nullptr;
+  }
   return uvm;
 }
 
 auto free_pagetable(uint64_t *pagetable, uint64_t sz) -> void {
   vm::uvm_unmap(pagetable, vm::TRAMPOLINE, 1, false);
   vm::uvm_unmap(pagetable, vm::TRAPFRAME, 1, false);
+  vm::uvm_unmap(pagetable, vm::VDATA, 1, false);
+  vm::uvm_unmap(pagetable, vm::URING, 2, false);
   vm::uvm_free(pagetable, sz);
 }
 
-auto free(struct process *p) -> void {
+// give back the trapframe and kernel stack alloc_slot took
+auto free_slot(struct process *p) -> void {
   if (p->trapframe) {
     vm::kfree(p->trapframe);
   }
   p->trapframe = nullptr;
+  vm::unmap_kstack(p->kernel_stack);
+  unhash_pid(p);
+}
+
+auto free(struct process *p) -> void {
+  free_slot(p);
+  if (p->vdata) {
+    vm::kfree(p->vdata);
+  }
+  p->vdata = nullptr;
+  auto *g = p->group;
   if (p->pagetable) {
-    free_pagetable(p->pagetable, p->sz);
+    free_pagetable(p->pagetable, g != nullptr ? g->sz : 0);
   }
   p->pagetable = nullptr;
-  p->sz = 0;
+  if (g != nullptr) {
+    uring::release(*g);
+    file::fd_free(g->fdt);
+    g->sz = 0;
+    g->cwd = nullptr;
+    g->leader = nullptr;
+    g->exiting = false;
+    g->lock.acquire();
+    g->slots = 0;
+    g->ref = 0;
+    g->lock.release();
+  }
+  p->group = nullptr;
   p->pid = 0;
   p->parent = nullptr;
   p->name[0] = '\0';
@@ -146,66 +301,214 @@ auto free(struct process *p) -> void {
   p->status = proc_status::UNUSED;
 }
 
-auto alloc_proc() -> struct process * {
-  for (auto &p : proc_list) {
-    p.lock.acquire();
-    if (p.status == proc_status::UNUSED) {
-      p.pid = alloc_pid();
-      p.status = proc_status::USED;
+auto alloc_group() -> struct group * {
+  do {
+    for (auto &g : group_list) {
+      g.lock.acquire();
+      if (g.ref == 0) {
+        g.ref = 1;
+        g.slots = 1;
+        g.lock.release();
+        return &g;
+      }
+      g.lock.release();
+    }
+  } while (group_list.grow(init_group));
+  return nullptr;
+}
 
+// an unused process with a fresh pid, trapframe and kernel stack,
+// returned locked. the table grows when every entry is taken.
+auto alloc_slot() -> struct process * {
+  do {
+    for (auto &p : proc_list) {
+      p.lock.acquire();
+      if (p.status != proc_status::UNUSED) {
+        p.lock.release();
+        continue;
+      }
       auto opt_frame = vm::kalloc();
       if (!opt_frame.has_value()) {
-        free(&p);
         p.lock.release();
         return nullptr;
       }
-      p.trapframe = (struct trapframe *)opt_frame.value();
-
-      p.pagetable = alloc_pagetable(p);
-      if (p.pagetable == nullptr) {
-        free(&p);
+      if (!vm::map_kstack(p.kernel_stack)) {
+        vm::kfree(opt_frame.value());
         p.lock.release();
         return nullptr;
       }
+      p.trapframe = (struct trapframe *)opt_frame.value();
+      p.pid = alloc_pid();
+      p.status = proc_status::USED;
+      hash_pid(&p);
+      p.slot = 0;
+      p.clear_tid = 0;
+      p.fp_used = false;
+      p.fp_cpu = NCPU;
+      // any hart may still cache the previous stack page at this address
+      p.stack_fence = ~0U;
 
       std::memset(&p.context, 0, sizeof(p.context));
       p.context.ra = (uint64_t)forkret;
       p.context.sp = p.kernel_stack + PGSIZE;
-
       return &p;
     }
-    p.lock.release();
-  }
-  fmt::panic("proc::alloc: no proc");
+  } while (proc_list.grow(init_slot));
 
   return nullptr;
 }
 
+auto alloc_proc() -> struct process * {
+  auto *p = alloc_slot();
+  if (p == nullptr) {
+    return nullptr;
+  }
+
+  p->group = alloc_group();
+  if (p->group == nullptr) {
+    free(p);
+    p->lock.release();
+    return nullptr;
+  }
+  p->group->leader = p;
+
+  auto opt_vdata = vm::kalloc();
+  if (!opt_vdata.has_value()) {
+    free(p);
+    p->lock.release();
+    return nullptr;
+  }
+  p->vdata = (struct vdata *)opt_vdata.value();
+  std::memset(p->vdata, 0, PGSIZE);
+  p->vdata->pid = p->pid;
+  p->vdata->boot_jiffies = timer::boot();
+  p->vdata->jiffy = timer::JIFFY;
+
+  p->pagetable = alloc_pagetable(*p);
+  if (p->pagetable == nullptr) {
+    free(p);
+    p->lock.release();
+    return nullptr;
+  }
+  return p;
+}
+
+// undo alloc_thread, p->lock must be held. returns the group so the
+// caller can wake an exiting leader once the lock is dropped.
+auto free_thread(struct process *p) -> struct group * {
+  auto *g = p->group;
+  g->lock.acquire();
+  if (p->pagetable != nullptr) {
+    vm::uvm_unmap(p->pagetable, vm::THREAD_TRAPFRAME(p->slot), 1, false);
+  }
+  g->slots &= ~(1U << p->slot);
+  --g->ref;
+  g->lock.release();
+
+  free_slot(p);
+  p->pagetable = nullptr;
+  p->group = nullptr;
+  p->slot = 0;
+  p->clear_tid = 0;
+  p->pid = 0;
+  p->parent = nullptr;
+  p->name[0] = '\0';
+  p->chan = nullptr;
+  p->killed = false;
+  p->status = proc_status::UNUSED;
+  return g;
+}
+
+// a new thread in the group of p, sharing its page table, with its
+// trapframe mapped at the slot's address. returned locked.
+auto alloc_thread(struct process *p) -> struct process * {
+  auto *np = alloc_slot();
+  if (np == nullptr) {
+    return nullptr;
+  }
+  auto *g = p->group;
+  g->lock.acquire();
+  // once exit has begun kill_threads may already have scanned the
+  // table, a thread started now would never be killed
+  if (g->exiting || g->slots == (1U << NTHREAD) - 1) {
+    g->lock.release();
+    free_slot(np);
+    np->pid = 0;
+    np->status = proc_status::UNUSED;
+    np->lock.release();
+    return nullptr;
+  }
+  np->slot = static_cast<uint32_t>(__builtin_ctz(~g->slots));
+  g->slots |= 1U << np->slot;
+  ++g->ref;
+  np->group = g;
+  auto ok = vm::map_pages(p->pagetable, vm::THREAD_TRAPFRAME(np->slot),
+                          (uint64_t)np->trapframe, PGSIZE, PTE_R | PTE_W);
+  g->lock.release();
+  if (!ok) {
+    free_thread(np);
+    np->lock.release();
+    return nullptr;
+  }
+  np->pagetable = p->pagetable;
+  return np;
+}
+
+// p->lock must be held. queues p on the hart it last ran on, its
+// cache and TLB state is most likely still there.
+auto make_runnable(struct process *p) -> void {
+  p->status = proc_status::RUNNABLE;
+  sched::enqueue(p, p->cpu);
+}
+
 auto scheduler() -> void {
   auto *c = curr_cpu();
   c->proc = nullptr;
+  sched::online(cpuid());
 
   while (true) {
     intr_on();
 
-    auto found{false};
-    for (uint32_t i{0}; i < NPROC; ++i) {
-      auto *p = &proc_list[i];
-      p->lock.acquire();
-      if (p->status == proc_status::RUNNABLE) {
-        p->status = proc_status::RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        c->proc = nullptr;
-        found = true;
+    sched::balance(cpuid());
+    // marked idle before looking, so a concurrent enqueue either sees
+    // the mark or is found by dequeue.
+    sched::set_idle(cpuid(), true);
+    auto *p = sched::dequeue(cpuid());
+    if (p == nullptr) {
+      // wfi also returns for an interrupt that is pending while sie is
+      // off, so one arriving after set_idle is not missed.
+      intr_off();
+      trap::set_idle();
+      asm volatile("wfi");
+      continue;
+    }
+    sched::set_idle(cpuid(), false);
+
+    // whoever queued p still holds its lock until it is off its
+    // hart, so RUNNABLE here is stable.
+    struct group *reaped{nullptr};
+    p->lock.acquire();
+    if (p->status == proc_status::RUNNABLE) {
+      p->status = proc_status::RUNNING;
+      c->proc = p;
+      if ((p->stack_fence & (1U << cpuid())) != 0) {
+        p->stack_fence &= ~(1U << cpuid());
+        sfence_vma();
+      }
+      trap::set_slice(sched::dispatch(p));
+      fpu::switch_in(p);
+      swtch(&c->context, &p->context);
+      fpu::switch_out(p);
+
+      c->proc = nullptr;
+      // an exited thread is off its kernel stack only now
+      if (p->status == proc_status::ZOMBIE && p->slot != 0) {
+        reaped = free_thread(p);
       }
-      p->lock.release();
     }
-
-    if (found == false) {
-      intr_on();
-      asm volatile("wfi");
+    p->lock.release();
+    if (reaped != nullptr) {
+      wakeup(reaped);
     }
   }
 }
@@ -223,6 +526,8 @@ auto sched() -> void {
     fmt::panic("proc::sched: interruptible");
   }
 
+  sched::charge(p);
+
   auto intena = curr_cpu()->intena;
   swtch(&p->context, &curr_cpu()->context);
   curr_cpu()->intena = intena;
@@ -231,7 +536,7 @@ auto sched() -> void {
 auto yield() -> void {
   auto *p = curr_proc();
   p->lock.acquire();
-  p->status = proc_status::RUNNABLE;
+  make_runnable(p);
   sched();
   p->lock.release();
 }
@@ -257,21 +562,50 @@ auto user_init() -> void {
   init_proc = p;
 
   vm::uvm_first(p->pagetable, (unsigned char *)initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  p->group->sz = PGSIZE;
 
   p->trapframe->epc = 0;
   p->trapframe->sp = PGSIZE;
   p->user = &root;
 
   std::strncpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = fs::namei((char *)"/");
-  p->status = proc_status::RUNNABLE;
+  p->group->cwd = fs::namei((char *)"/");
+  sched::init_proc(p, 0, sched::ALL_HARTS);
+  make_runnable(p);
 
   p->lock.release();
 }
 
+// sleepers are hashed by channel so wakeup only looks at processes
+// that can possibly match. lock order: bucket lock, then process lock;
+// sleep never takes a bucket lock while holding its own process lock.
+constexpr uint32_t SLEEPQ_BITS{6};
+
+struct sleepq {
+  class lock::spinlock lock{"sleepq"};
+  struct process *head;
+};
+struct sleepq sleepqs[1U << SLEEPQ_BITS];
+
+static inline auto sleepq_of(void *chan) -> struct sleepq & {
+  auto h = ((uint64_t)chan * 0x9E3779B97F4A7C15ULL) >> (64 - SLEEPQ_BITS);
+  return sleepqs[h];
+}
+
 auto sleep(void *chan, class lock::spinlock &lock) -> void {
   auto *p = curr_proc();
+  auto &q = sleepq_of(chan);
+
+  // get on the queue while the condition lock is still held, a wakeup
+  // issued after it is dropped then always finds us.
+  q.lock.acquire();
+  p->wq_prev = nullptr;
+  p->wq_next = q.head;
+  if (q.head != nullptr) {
+    q.head->wq_prev = p;
+  }
+  q.head = p;
+  q.lock.release();
 
   p->lock.acquire();
   lock.release();
@@ -283,44 +617,95 @@ auto sleep(void *chan, class lock::spinlock &lock) -> void {
 
   p->chan = nullptr;
   p->lock.release();
+
+  q.lock.acquire();
+  if (p->wq_prev != nullptr) {
+    p->wq_prev->wq_next = p->wq_next;
+  } else {
+    q.head = p->wq_next;
+  }
+  if (p->wq_next != nullptr) {
+    p->wq_next->wq_prev = p->wq_prev;
+  }
+  q.lock.release();
+
   lock.acquire();
 }
 
 auto wakeup(void *chan) -> void {
-  for (auto &p : proc_list) {
-    if (&p != curr_proc()) {
-      p.lock.acquire();
-      if (p.status == proc_status::SLEEPING && p.chan == chan) {
-        p.status = proc_status::RUNNABLE;
+  auto &q = sleepq_of(chan);
+  q.lock.acquire();
+  for (auto *p = q.head; p != nullptr; p = p->wq_next) {
+    if (p != curr_proc()) {
+      p->lock.acquire();
+      if (p->status == proc_status::SLEEPING && p->chan == chan) {
+        make_runnable(p);
       }
-      p.lock.release();
+      p->lock.release();
     }
   }
+  q.lock.release();
+}
+
+auto wakeup_proc(struct process *p, void *chan) -> void {
+  p->lock.acquire();
+  if (p->status == proc_status::SLEEPING && p->chan == chan) {
+    make_runnable(p);
+  }
+  p->lock.release();
 }
 
+// hand the children of p to init, wait_lock must be held
 auto reparent(struct process &p) -> void {
-  for (auto &cp : proc_list) {
-    if (cp.parent == &p) {
-      cp.parent = init_proc;
-      wakeup(init_proc);
-    }
+  if (p.children == nullptr) {
+    return;
+  }
+  struct process *last{nullptr};
+  for (auto *cp = p.children; cp != nullptr; cp = cp->sibling_next) {
+    cp->parent = init_proc;
+    last = cp;
   }
+  last->sibling_next = init_proc->children;
+  if (init_proc->children != nullptr) {
+    init_proc->children->sibling_prev = last;
+  }
+  init_proc->children = p.children;
+  p.children = nullptr;
+  wakeup(init_proc);
 }
 
 auto kill(uint32_t pid) -> int {
-  for (auto &p : proc_list) {
-    p.lock.acquire();
-    if (p.pid == pid) {
-      p.killed = true;
-      if (p.status == proc_status::SLEEPING) {
-        p.status = proc_status::RUNNABLE;
-      }
-      p.lock.release();
-      return 0;
-    }
-    p.lock.release();
+  auto *p = find(pid);
+  if (p == nullptr) {
+    return -1;
+  }
+  p->killed = true;
+  if (p->status == proc_status::SLEEPING) {
+    make_runnable(p);
+  }
+  p->lock.release();
+  return 0;
+}
+
+// the live process with the given pid, returned with its lock held
+auto find(uint32_t pid) -> struct process * {
+  pid_lock.acquire();
+  auto *p = *pid_bucket(pid);
+  while (p != nullptr && p->pid != pid) {
+    p = p->hash_next;
   }
-  return -1;
+  pid_lock.release();
+  if (p == nullptr) {
+    return nullptr;
+  }
+
+  // it may have been reaped between the lookup and the lock
+  p->lock.acquire();
+  if (p->pid != pid || p->status == proc_status::UNUSED) {
+    p->lock.release();
+    return nullptr;
+  }
+  return p;
 }
 
 auto set_killed(struct process *proc) -> void {
@@ -336,19 +721,61 @@ auto get_killed(struct process *proc) -> bool {
   return rs;
 }
 
+// other threads may still have the dropped pages in their tlbs, so
+// the pages are unmapped first and only freed after a shootdown. the
+// shootdown cannot happen under g->lock, a batch at a time is taken off
+// the top so that the addresses fit on the stack.
+auto shrink_shared(struct process *p, uint64_t n) -> void {
+  constexpr uint64_t BATCH{32};
+  uint64_t pa[BATCH];
+  auto *g = p->group;
+  while (n > 0) {
+    g->lock.acquire();
+    auto oldsz = g->sz;
+    auto newsz = n < oldsz ? oldsz - n : 0;
+    if (PG_ROUND_UP(oldsz) - PG_ROUND_UP(newsz) > BATCH * PGSIZE) {
+      newsz = PG_ROUND_UP(oldsz) - BATCH * PGSIZE;
+    }
+    auto npages = (PG_ROUND_UP(oldsz) - PG_ROUND_UP(newsz)) / PGSIZE;
+    vm::uvm_detach(p->pagetable, PG_ROUND_UP(newsz), npages, pa);
+    g->sz = newsz;
+    g->lock.release();
+    n = newsz == 0 ? 0 : n - (oldsz - newsz);
+
+    ipi::tlb_shootdown(sched::online_harts());
+    for (uint64_t i{0}; i < npages; ++i) {
+      if (pa[i] != 0) {
+        vm::kfree((void *)pa[i]);
+      }
+    }
+  }
+}
+
 auto grow(int n) -> int {
   auto *p = curr_proc();
-  auto sz = p->sz;
+  auto *g = p->group;
+  g->lock.acquire();
+  auto sz = g->sz;
 
   if (n > 0) {
     if ((sz = vm::uvm_alloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+      g->lock.release();
       return -1;
     }
+  } else if (n < 0 && g->ref > 1) {
+    // like uvm_dealloc, shrinking below 0 leaves the size alone
+    auto dec = static_cast<uint64_t>(-static_cast<int64_t>(n));
+    g->lock.release();
+    if (dec <= sz) {
+      shrink_shared(p, dec);
+    }
+    return 0;
   } else if (n < 0) {
     sz = vm::uvm_dealloc(p->pagetable, sz, sz + n);
   }
 
-  p->sz = sz;
+  g->sz = sz;
+  g->lock.release();
   return 0;
 }
 
@@ -359,23 +786,32 @@ auto fork() -> int32_t {
   }
 
   auto *p = curr_proc();
+  auto *g = p->group;
 
-  if (vm::uvm_copy(p->pagetable, np->pagetable, p->sz) == false) {
+  g->lock.acquire();
+  auto ok = vm::uvm_copy(p->pagetable, np->pagetable, g->sz);
+  np->group->sz = g->sz;
+  g->lock.release();
+  if (ok == false) {
     free(np);
     np->lock.release();
     return -1;
   }
-  np->sz = p->sz;
   *(np->trapframe) = *(p->trapframe);
   np->trapframe->a0 = 0;
   np->user = p->user;
+  fpu::flush(p);
+  np->fp = p->fp;
+  np->fp_used = p->fp_used;
 
-  for (uint32_t i{0}; i < file::NOFILE; ++i) {
-    if (p->ofile[i] != nullptr) {
-      np->ofile[i] = file::dup(p->ofile[i]);
-    }
+  if (file::fd_copy(np->group->fdt, g->fdt) == false) {
+    free(np);
+    np->lock.release();
+    return -1;
   }
-  np->cwd = fs::idup(p->cwd);
+  g->lock.acquire();
+  np->group->cwd = fs::idup(g->cwd);
+  g->lock.release();
 
   std::strncpy(np->name, p->name, sizeof(p->name));
 
@@ -383,34 +819,118 @@ auto fork() -> int32_t {
 
   np->lock.release();
 
+  // a child forked by any thread belongs to the process
   wait_lock.acquire();
-  np->parent = p;
+  link_child(g->leader, np);
   wait_lock.release();
 
   np->lock.acquire();
-  np->status = proc_status::RUNNABLE;
+  sched::init_proc(np, p->nice, p->affinity);
+  np->cpu = sched::select_cpu(np->affinity);
+  make_runnable(np);
+  np->lock.release();
+
+  return static_cast<int32_t>(rs);
+}
+
+// a new thread of the calling process that starts where the caller
+// returns to, with its own stack and thread pointer. when ctid is not
+// 0 the thread zeroes that word and wakes its futex on exit.
+auto clone(uint64_t stack, uint64_t tls, uint64_t ctid) -> int32_t {
+  auto *p = curr_proc();
+  auto *np = alloc_thread(p);
+  if (np == nullptr) {
+    return -1;
+  }
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->a0 = 0;
+  np->trapframe->sp = stack;
+  np->trapframe->tp = tls;
+  np->clear_tid = ctid;
+  np->user = p->user;
+  fpu::flush(p);
+  np->fp = p->fp;
+  np->fp_used = p->fp_used;
+  std::strncpy(np->name, p->name, sizeof(p->name));
+
+  auto rs = np->pid;
+  sched::init_proc(np, p->nice, p->affinity);
+  np->cpu = sched::select_cpu(np->affinity);
+  make_runnable(np);
   np->lock.release();
 
   return static_cast<int32_t>(rs);
 }
 
+// make every other thread of p's group exit and wait until they are
+// reaped, afterwards p is alone with the shared state.
+auto kill_threads(struct process &p) -> void {
+  auto *g = p.group;
+  g->lock.acquire();
+  auto alone = g->ref == 1;
+  g->lock.release();
+  if (alone) {
+    return;
+  }
+
+  for (auto &t : proc_list) {
+    if (&t == &p) {
+      continue;
+    }
+    t.lock.acquire();
+    if (t.group == g && t.status != proc_status::UNUSED) {
+      t.killed = true;
+      if (t.status == proc_status::SLEEPING) {
+        make_runnable(&t);
+      }
+    }
+    t.lock.release();
+  }
+
+  g->lock.acquire();
+  while (g->ref > 1) {
+    sleep(g, g->lock);
+  }
+  g->lock.release();
+}
+
+// exit from any thread ends the whole process. the other threads are
+// killed and the leader does the teardown once it is alone.
 auto exit(int status) -> void {
   auto *p = curr_proc();
+  auto *g = p->group;
+  if (p != g->leader) {
+    g->lock.acquire();
+    if (!g->exiting) {
+      g->exiting = true;
+      g->xstate = status;
+    }
+    g->lock.release();
+    kill(g->leader->pid);
+    thread_exit(status);
+  }
   if (p == init_proc) {
     fmt::panic("proc::exit: init exiting");
   }
 
-  for (uint32_t fd{0}; fd < file::NOFILE; ++fd) {
-    if (p->ofile[fd] != nullptr) {
-      file::close(p->ofile[fd]);
-      p->ofile[fd] = nullptr;
-    }
+  // claim the status before the killed threads exit with -1, unless
+  // some thread got here first
+  g->lock.acquire();
+  if (!g->exiting) {
+    g->exiting = true;
+    g->xstate = status;
   }
+  status = g->xstate;
+  g->lock.release();
+  kill_threads(*p);
+
+  file::fd_close_all(g->fdt);
 
   log::begin_op();
-  fs::iput(p->cwd);
+  fs::iput(g->cwd);
   log::end_op();
-  p->cwd = nullptr;
+  g->cwd = nullptr;
 
   wait_lock.acquire();
   reparent(*p);
@@ -427,37 +947,59 @@ auto exit(int status) -> void {
   fmt::panic("proc::exit: zombie exit");
 }
 
+// end the calling thread only, the scheduler frees it once it is off
+// its kernel stack. the leader cannot go first, it holds the pid.
+auto thread_exit(int status) -> void {
+  auto *p = curr_proc();
+  if (p == p->group->leader) {
+    exit(status);
+  }
+
+  if (p->clear_tid != 0) {
+    uint32_t zero{0};
+    vm::copyout(p->pagetable, p->clear_tid, (char *)&zero, sizeof(zero));
+    futex::wake(p->pagetable, p->clear_tid, ~0U);
+  }
+
+  p->lock.acquire();
+  p->xstate = status;
+  p->status = proc_status::ZOMBIE;
+  sched();
+  fmt::panic("proc::thread_exit: zombie exit");
+}
+
 auto wait(uint64_t addr) -> int {
   wait_lock.acquire();
-  auto *p = curr_proc();
+  // children belong to the process, any thread may wait for them
+  auto *p = curr_proc()->group->leader;
 
   while (true) {
     auto havekids{false};
 
-    for (auto &cp : proc_list) {
-      if (cp.parent == p) {
-        cp.lock.acquire();
-
-        havekids = true;
-        if (cp.status == proc_status::ZOMBIE) {
-          auto pid = cp.pid;
-          if (addr != 0 && vm::copyout(p->pagetable, addr, (char *)&cp.xstate,
-                                       sizeof(cp.xstate)) == false) {
-            cp.lock.release();
-            wait_lock.release();
-            return -1;
-          }
-          free(&cp);
-          cp.lock.release();
+    for (auto *cp = p->children; cp != nullptr; cp = cp->sibling_next) {
+      cp->lock.acquire();
+
+      havekids = true;
+      if (cp->status == proc_status::ZOMBIE) {
+        auto pid = cp->pid;
+        if (addr != 0 && vm::copyout(p->pagetable, addr, (char *)&cp->xstate,
+                                     sizeof(cp->xstate)) == false) {
+          cp->lock.release();
           wait_lock.release();
-          return static_cast<int32_t>(pid);
+          return -1;
         }
-
-        cp.lock.release();
+        unlink_child(cp);
+        free(cp);
+        cp->lock.release();
+        wait_lock.release();
+        return static_cast<int32_t>(pid);
       }
+
+      cp->lock.release();
     }
 
-    if (havekids == false || get_killed(p)) {
+    // the caller, not the leader, is the one kill_threads marks
+    if (havekids == false || get_killed(curr_proc())) {
       wait_lock.release();
       return -1;
     }
@@ -495,7 +1037,7 @@ auto either_copyout(bool user_dst, uint64_t dst, void *src, uint64_t len)
     -> int {
   auto *p = curr_proc();
   if (user_dst) {
-    return vm::copyout(p->pagetable, dst, (char *)src, len);
+    return vm::copyout(p->pagetable, dst, (char *)src, len) ? 0 : -1;
   }
   std::memmove((char *)dst, src, len);
   return 0;
@@ -505,7 +1047,7 @@ auto either_copyin(void *dst, bool user_dst, uint64_t src, uint64_t len)
     -> int {
   auto *p = curr_proc();
   if (user_dst) {
-    return vm::copyin(p->pagetable, (char *)dst, src, len);
+    return vm::copyin(p->pagetable, (char *)dst, src, len) ? 0 : -1;
   }
   std::memmove(dst, (char *)src, len);
   return 0;
@@ -1,13 +1,18 @@
 #pragma once
 #include <cstdint>
 
+#include "fdtable.h"
 #include "file.h"
 #include "lock.h"
+#include "timer.h"
+#include "uring.h"
 
 namespace proc {
-constexpr uint32_t NPROC{64};
+constexpr uint32_t NUSER{64};
 constexpr uint32_t NCPU{8};
 constexpr uint32_t ROOT_ID{0};
+constexpr uint32_t NTHREAD{16};  // threads per process
+constexpr uint32_t PID_HASH_BITS{8};
 
 struct context {
   uint64_t ra;
@@ -28,6 +33,13 @@ struct context {
   uint64_t s11;
 };
 
+// user floating-point registers, only written back when a process
+// leaves its hart with sstatus.FS dirty. fpu.S relies on this layout.
+struct fpstate {
+  /*   0 */ uint64_t f[32];
+  /* 256 */ uint64_t fcsr;
+};
+
 struct trapframe {
   /*   0 */ uint64_t kernel_satp;    // kernel page table
   /*   8 */ uint64_t kernel_sp;      // top of process's kernel stack
@@ -67,12 +79,40 @@ struct trapframe {
   /* 280 */ uint64_t t6;
 };
 
+// per-process page mapped read-only at vm::VDATA, user space reads it
+// instead of trapping for getpid() and uptime(). ulibc mirrors this
+// layout in src/include/vdata.h.
+struct vdata {
+  /*  0 */ uint32_t pid;
+  /*  4 */ uint32_t pad;
+  /*  8 */ uint64_t boot_jiffies;  // timer::jiffies() at boot
+  /* 16 */ uint64_t jiffy;         // time csr cycles per jiffy
+};
+
 struct user {
   uint32_t uid{0};
   uint32_t gid{0};
   class lock::spinlock lock{};
 };
 
+// what the threads of one process share. a process that never called
+// clone is a group of one. the page table pointer is copied into every
+// thread instead, it only changes in exec, which needs a lone thread.
+struct group {
+  class lock::spinlock lock{};
+  uint32_t ref;    // threads attached, 0 when unused
+  uint32_t slots;  // trapframe slots in use, see vm::THREAD_TRAPFRAME
+  struct process *leader;  // the thread fork created, its pid is the pid
+  uint64_t sz;
+  struct file::fdtable fdt;
+  struct file::inode *cwd;
+  bool exiting;  // exit has begun, xstate is the status
+  int xstate;
+  // mapped into the shared page table, nullptr until uring_setup
+  struct uring::sqring *sq;
+  struct uring::cqring *cq;
+};
+
 struct cpu {
   struct process *proc;
   struct context context;
@@ -96,19 +136,47 @@ struct process {
   struct user::user *user;
 
   struct process *parent;
+  struct process *children;  // wait_lock guards these and parent
+  struct process *sibling_next;
+  struct process *sibling_prev;
+  struct process *hash_next;  // pid hash chain, under pid_lock
+
+  struct process *rq_next;  // run queue link while RUNNABLE
+  uint32_t level;           // mlfq level, see sched.h
+  int8_t nice;
+  uint64_t slice_used;      // cycles used at this level
+  uint64_t run_start;       // r_time() when last dispatched
+  uint64_t epoch;           // boost period the level belongs to
+  struct process *wq_next;  // sleep queue links, see proc::sleep
+  struct process *wq_prev;
+  uint32_t cpu;             // hart whose run queue it was last put on
+  uint32_t affinity;        // harts it may run on, bit n for hart n
+  uint64_t dl_runtime;      // deadline class, 0 for mlfq processes
+  uint64_t dl_deadline;
+  uint64_t dl_period;
+  uint64_t dl_bw;           // runtime/period, see sched::DL_BW_SHIFT
+  uint64_t dl_abs;          // absolute deadline of the current period
+  uint64_t dl_budget;       // runtime left until dl_abs
+  bool dl_throttled;        // budget spent, dl_timer requeues it
+  struct timer::timer dl_timer;
+
+  struct group *group;
+  uint32_t slot;       // trapframe slot in the group
+  uint64_t clear_tid;  // user word zeroed and woken on thread exit
 
   uint64_t kernel_stack;
-  uint64_t sz;
+  uint32_t stack_fence;  // harts to sfence.vma on before running on it
   uint64_t *pagetable;
   struct trapframe *trapframe;
+  struct vdata *vdata;
   struct context context;
-  struct file::file *ofile[file::NOFILE];
-  struct file::inode *cwd;
+  struct fpstate fp;
+  bool fp_used;     // fp is meaningful, otherwise the first use starts zeroed
+  uint32_t fp_cpu;  // hart whose registers hold fp, NCPU when none
 };
 
 auto init() -> void;
 auto user_init() -> void;
-auto map_stack(uint64_t *kpt) -> void;
 auto cpuid() -> uint32_t;
 auto curr_proc() -> struct process *;
 auto curr_cpu() -> struct cpu *;
@@ -116,13 +184,18 @@ auto alloc_pagetable(struct process &p) -> uint64_t *;
 auto free_pagetable(uint64_t *pagetable, uint64_t sz) -> void;
 auto sleep(void *chan, class lock::spinlock &lock) -> void;
 auto wakeup(void *chan) -> void;
+auto wakeup_proc(struct process *p, void *chan) -> void;
 auto yield() -> void;
+auto make_runnable(struct process *p) -> void;
 auto scheduler() -> void;
 auto grow(int n) -> int;
 auto fork() -> int32_t;
+auto clone(uint64_t stack, uint64_t tls, uint64_t ctid) -> int32_t;
 auto exit(int status) -> void;
+auto thread_exit(int status) -> void;
 auto wait(uint64_t addr) -> int;
 auto kill(uint32_t pid) -> int;
+auto find(uint32_t pid) -> struct process *;
 auto get_killed(struct process *proc) -> bool;
 auto set_killed(struct process *proc) -> void;
 auto dump(struct process &p) -> void;
@@ -0,0 +1,613 @@
+#include "sched.h"
+
+#include <cstdint>
+
+#ifndef ARCH_RISCV
+#include "arch/riscv.h"
+#define ARCH_RISCV
+#endif
+
+#include "ipi.h"
+#include "lock.h"
+#include "proc.h"
+#include "timer.h"
+
+namespace sched {
+struct runqueue runqueues[proc::NCPU];
+uint32_t online_mask;  // harts running the scheduler loop
+uint32_t idle_mask;    // harts parked in wfi with an empty queue
+class lock::spinlock dl_lock{"dl"};  // admission control
+
+auto replenish(void *arg) -> void;
+
+static inline auto epoch() -> uint64_t { return r_time() / BOOST_INTERVAL; }
+
+// niceness 0 and below start at the top, positive values start lower.
+static inline auto home_level(int nice) -> uint32_t {
+  if (nice <= 0) {
+    return 0;
+  }
+  auto level = static_cast<uint32_t>((nice + 6) / 7);
+  return level < NLEVEL ? level : NLEVEL - 1;
+}
+
+// negative niceness stretches the quantum, -10 doubles it.
+static inline auto quantum(struct proc::process *p) -> uint64_t {
+  auto q = QUANTUM[p->level];
+  if (p->nice < 0) {
+    q += q * static_cast<uint64_t>(-p->nice) / 10;
+  }
+  return q;
+}
+
+static inline auto reset(struct proc::process *p) -> void {
+  p->level = home_level(p->nice);
+  p->slice_used = 0;
+  p->epoch = epoch();
+}
+
+static inline auto is_dl(struct proc::process *p) -> bool {
+  return p->dl_runtime != 0;
+}
+
+// the deadline class is not inherited
+auto init_proc(struct proc::process *p, int nice, uint32_t affinity) -> void {
+  p->nice = static_cast<int8_t>(nice);
+  p->affinity = affinity;
+  p->dl_runtime = 0;
+  p->dl_bw = 0;
+  p->dl_throttled = false;
+  p->dl_timer.fn = replenish;
+  p->dl_timer.arg = p;
+  reset(p);
+}
+
+auto online(uint32_t cpu) -> void {
+  __atomic_fetch_or(&online_mask, 1U << cpu, __ATOMIC_RELEASE);
+}
+
+auto online_harts() -> uint32_t {
+  return __atomic_load_n(&online_mask, __ATOMIC_ACQUIRE);
+}
+
+auto set_idle(uint32_t cpu, bool idle) -> void {
+  if (idle) {
+    __atomic_fetch_or(&idle_mask, 1U << cpu, __ATOMIC_SEQ_CST);
+  } else {
+    __atomic_fetch_and(&idle_mask, ~(1U << cpu), __ATOMIC_SEQ_CST);
+  }
+}
+
+// rq.lock must be held
+auto push(struct runqueue &rq, struct proc::process *p) -> void {
+  p->cpu = static_cast<uint32_t>(&rq - runqueues);
+  p->rq_next = nullptr;
+  auto l = p->level;
+  if (rq.tail[l] != nullptr) {
+    rq.tail[l]->rq_next = p;
+  } else {
+    rq.head[l] = p;
+  }
+  rq.tail[l] = p;
+  rq.bitmap |= 1U << l;
+  __atomic_store_n(&rq.nr, rq.nr + 1, __ATOMIC_RELAXED);
+}
+
+// rq.lock must be held, prev is p's predecessor on level l or nullptr.
+auto unlink(struct runqueue &rq, uint32_t l, struct proc::process *p,
+            struct proc::process *prev) -> void {
+  if (prev != nullptr) {
+    prev->rq_next = p->rq_next;
+  } else {
+    rq.head[l] = p->rq_next;
+  }
+  if (rq.tail[l] == p) {
+    rq.tail[l] = prev;
+  }
+  if (rq.head[l] == nullptr) {
+    rq.bitmap &= ~(1U << l);
+  }
+  p->rq_next = nullptr;
+  __atomic_store_n(&rq.nr, rq.nr - 1, __ATOMIC_RELAXED);
+}
+
+// rq.lock must be held, the queue is kept sorted by absolute deadline
+auto dl_push(struct runqueue &rq, struct proc::process *p) -> void {
+  p->cpu = static_cast<uint32_t>(&rq - runqueues);
+  auto **pp = &rq.dl_head;
+  while (*pp != nullptr && (*pp)->dl_abs <= p->dl_abs) {
+    pp = &(*pp)->rq_next;
+  }
+  p->rq_next = *pp;
+  *pp = p;
+}
+
+// rq.lock must be held
+auto dl_unlink(struct runqueue &rq, struct proc::process *p) -> bool {
+  for (auto **pp = &rq.dl_head; *pp != nullptr; pp = &(*pp)->rq_next) {
+    if (*pp == p) {
+      *pp = p->rq_next;
+      p->rq_next = nullptr;
+      return true;
+    }
+  }
+  return false;
+}
+
+// the first process in priority order that may run on cpu.
+// rq.lock must be held
+auto pop(struct runqueue &rq, uint32_t cpu) -> struct proc::process * {
+  for (auto bits = rq.bitmap; bits != 0; bits &= bits - 1) {
+    auto l = static_cast<uint32_t>(__builtin_ctz(bits));
+    struct proc::process *prev{nullptr};
+    for (auto *p = rq.head[l]; p != nullptr; prev = p, p = p->rq_next) {
+      if ((p->affinity & (1U << cpu)) != 0) {
+        unlink(rq, l, p, prev);
+        return p;
+      }
+    }
+  }
+  return nullptr;
+}
+
+// take a queued process off its run queue. p->lock must be held.
+// false when some hart already took it to run it.
+auto remove(struct proc::process *p) -> bool {
+  // balance moves queued processes without p->lock, p->cpu is only
+  // stable under the lock of the queue it names
+  auto cpu = __atomic_load_n(&p->cpu, __ATOMIC_RELAXED);
+  runqueues[cpu].lock.acquire();
+  while (p->cpu != cpu) {
+    runqueues[cpu].lock.release();
+    cpu = __atomic_load_n(&p->cpu, __ATOMIC_RELAXED);
+    runqueues[cpu].lock.acquire();
+  }
+  auto &rq = runqueues[cpu];
+  if (is_dl(p)) {
+    auto rs = dl_unlink(rq, p);
+    rq.lock.release();
+    return rs;
+  }
+  // after a boost the process may sit on a different level than p->level
+  for (uint32_t l{0}; l < NLEVEL; ++l) {
+    struct proc::process *prev{nullptr};
+    for (auto *q = rq.head[l]; q != nullptr; prev = q, q = q->rq_next) {
+      if (q == p) {
+        unlink(rq, l, p, prev);
+        rq.lock.release();
+        return true;
+      }
+    }
+  }
+  rq.lock.release();
+  return false;
+}
+
+// the online hart with the longest queue other than cpu, the lengths
+// are read without locks and only used as a hint.
+auto busiest(uint32_t cpu) -> struct runqueue * {
+  auto mask = __atomic_load_n(&online_mask, __ATOMIC_ACQUIRE);
+  struct runqueue *rs{nullptr};
+  uint32_t max{0};
+  for (uint32_t i{0}; i < proc::NCPU; ++i) {
+    if (i == cpu || (mask & (1U << i)) == 0) {
+      continue;
+    }
+    auto nr = __atomic_load_n(&runqueues[i].nr, __ATOMIC_RELAXED);
+    if (nr > max) {
+      max = nr;
+      rs = &runqueues[i];
+    }
+  }
+  return rs;
+}
+
+// where a process allowed on mask goes: the online hart in mask with the
+// shortest queue, preferring the current one.
+auto select_cpu(uint32_t mask) -> uint32_t {
+  mask &= __atomic_load_n(&online_mask, __ATOMIC_ACQUIRE);
+  auto cpu = proc::cpuid();
+  if (mask == 0) {
+    return cpu;
+  }
+  if ((mask & (1U << cpu)) == 0) {
+    cpu = static_cast<uint32_t>(__builtin_ctz(mask));
+  }
+  auto min = __atomic_load_n(&runqueues[cpu].nr, __ATOMIC_RELAXED);
+  for (uint32_t i{0}; i < proc::NCPU && min > 0; ++i) {
+    if ((mask & (1U << i)) == 0) {
+      continue;
+    }
+    auto nr = __atomic_load_n(&runqueues[i].nr, __ATOMIC_RELAXED);
+    if (nr < min) {
+      min = nr;
+      cpu = i;
+    }
+  }
+  return cpu;
+}
+
+// a deadline process goes to the hart it was admitted on. one that
+// wakes up keeps its budget and deadline only while they still fit its
+// bandwidth, otherwise it starts a fresh period now (cbs).
+auto enqueue_dl(struct proc::process *p) -> void {
+  if (p->dl_throttled) {
+    return;
+  }
+  if (p != proc::curr_proc()) {
+    auto now = r_time();
+    if (now >= p->dl_abs ||
+        p->dl_budget * p->dl_period > (p->dl_abs - now) * p->dl_runtime) {
+      p->dl_abs = now + p->dl_deadline;
+      p->dl_budget = p->dl_runtime;
+    }
+  }
+
+  auto cpu = p->cpu;
+  auto &rq = runqueues[cpu];
+  rq.lock.acquire();
+  dl_push(rq, p);
+  auto preempt = p->dl_abs < rq.curr_deadline;
+  if (preempt) {
+    rq.need_resched = true;
+  }
+  rq.lock.release();
+
+  auto idle = __atomic_load_n(&idle_mask, __ATOMIC_SEQ_CST) & (1U << cpu);
+  if ((idle != 0 || preempt) && cpu != proc::cpuid()) {
+    ipi::send(cpu, ipi::RESCHED);
+  }
+}
+
+// p->lock must be held and p must already be RUNNABLE.
+auto enqueue(struct proc::process *p, uint32_t cpu) -> void {
+  if (is_dl(p)) {
+    enqueue_dl(p);
+    return;
+  }
+  if (p->epoch != epoch()) {
+    reset(p);
+  }
+  if ((p->affinity & (1U << cpu)) == 0) {
+    cpu = select_cpu(p->affinity);
+  }
+
+  auto &rq = runqueues[cpu];
+  rq.lock.acquire();
+  push(rq, p);
+  auto preempt = p->level < rq.curr_level;
+  if (preempt) {
+    rq.need_resched = true;
+  }
+  rq.lock.release();
+
+  // idle harts are not ticking. kick the target when it sleeps or has to
+  // preempt, otherwise wake an idle hart that may steal p.
+  auto self = proc::cpuid();
+  auto idle = __atomic_load_n(&idle_mask, __ATOMIC_SEQ_CST) & online_harts();
+  if ((idle & (1U << cpu)) != 0 || preempt) {
+    if (cpu != self) {
+      ipi::send(cpu, ipi::RESCHED);
+    }
+  } else if (p != proc::curr_proc() && (idle & p->affinity) != 0) {
+    ipi::send(static_cast<uint32_t>(__builtin_ctz(idle & p->affinity)),
+              ipi::RESCHED);
+  }
+}
+
+// priority boost: splice every lower level onto the top one. levels
+// of the moved processes are fixed up lazily when they are dispatched.
+auto boost(struct runqueue &rq) -> void {
+  for (uint32_t l{1}; l < NLEVEL; ++l) {
+    if (rq.head[l] == nullptr) {
+      continue;
+    }
+    if (rq.tail[0] != nullptr) {
+      rq.tail[0]->rq_next = rq.head[l];
+    } else {
+      rq.head[0] = rq.head[l];
+    }
+    rq.tail[0] = rq.tail[l];
+    rq.head[l] = rq.tail[l] = nullptr;
+  }
+  rq.bitmap = rq.nr > 0 ? 1U : 0U;
+}
+
+// an idle hart takes the next process of the busiest one.
+auto steal(uint32_t cpu) -> struct proc::process * {
+  auto *victim = busiest(cpu);
+  if (victim == nullptr) {
+    return nullptr;
+  }
+  victim->lock.acquire();
+  auto *p = pop(*victim, cpu);
+  if (p != nullptr) {
+    p->cpu = cpu;
+  }
+  victim->lock.release();
+  return p;
+}
+
+auto dequeue(uint32_t cpu) -> struct proc::process * {
+  auto &rq = runqueues[cpu];
+  rq.lock.acquire();
+  if (auto e = epoch(); rq.epoch != e) {
+    rq.epoch = e;
+    boost(rq);
+  }
+  auto *p = rq.dl_head;
+  if (p != nullptr) {
+    rq.dl_head = p->rq_next;
+    p->rq_next = nullptr;
+  } else {
+    p = pop(rq, cpu);
+  }
+  rq.lock.release();
+  if (p == nullptr) {
+    p = steal(cpu);
+  }
+  return p;
+}
+
+// periodic pull: when the busiest hart has at least two more queued
+// processes than this one, move half the difference over.
+auto balance(uint32_t cpu) -> void {
+  auto &rq = runqueues[cpu];
+  auto now = r_time();
+  if (now < rq.next_balance) {
+    return;
+  }
+  rq.next_balance = now + BALANCE_INTERVAL;
+
+  auto *victim = busiest(cpu);
+  if (victim == nullptr) {
+    return;
+  }
+  // take both locks in address order
+  auto *first = victim < &rq ? victim : &rq;
+  auto *second = victim < &rq ? &rq : victim;
+  first->lock.acquire();
+  second->lock.acquire();
+  if (victim->nr > rq.nr + 1) {
+    for (auto n = (victim->nr - rq.nr) / 2; n > 0; --n) {
+      auto *p = pop(*victim, cpu);
+      if (p == nullptr) {
+        break;  // the rest is pinned elsewhere
+      }
+      push(rq, p);
+    }
+  }
+  second->lock.release();
+  first->lock.release();
+}
+
+// p is about to run on this hart, returns when its slice ends. for a
+// deadline process that is when its budget runs out.
+auto dispatch(struct proc::process *p) -> uint64_t {
+  auto &rq = runqueues[proc::cpuid()];
+  rq.need_resched = false;
+  if (is_dl(p)) {
+    rq.curr_level = 0;
+    rq.curr_deadline = p->dl_abs;
+    p->run_start = r_time();
+    return p->run_start + p->dl_budget;
+  }
+
+  if (p->epoch != epoch()) {
+    reset(p);
+  }
+  rq.curr_level = p->level;
+  rq.curr_deadline = ~0ULL;
+
+  auto q = quantum(p);
+  if (p->slice_used >= q) {
+    // the quantum shrank under it through nice()
+    p->slice_used = 0;
+  }
+  auto now = r_time();
+  p->run_start = now;
+  return now + q - p->slice_used;
+}
+
+// give back the bandwidth p was admitted with
+auto dl_release(struct proc::process *p) -> void {
+  dl_lock.acquire();
+  runqueues[p->cpu].dl_bw -= p->dl_bw;
+  dl_lock.release();
+  p->dl_runtime = 0;
+  p->dl_bw = 0;
+}
+
+// the budget of p ran out. a yield may have queued it already. when
+// its hart took it off the queue in the meantime it runs there with no
+// budget and is throttled right after.
+auto throttle(struct proc::process *p) -> void {
+  if (p->status == proc::proc_status::RUNNABLE && !remove(p)) {
+    return;
+  }
+  p->dl_throttled = true;
+  auto next = p->dl_abs - p->dl_deadline + p->dl_period;
+  timer::add(p->dl_timer, (next + timer::JIFFY - 1) / timer::JIFFY);
+}
+
+// the next period of a throttled process starts, runs from the timer
+// wheel of the hart that throttled it.
+auto replenish(void *arg) -> void {
+  auto *p = static_cast<struct proc::process *>(arg);
+  p->lock.acquire();
+  p->dl_throttled = false;
+  p->dl_abs += p->dl_period;
+  p->dl_budget = p->dl_runtime;
+  if (auto now = r_time(); p->dl_abs <= now) {
+    p->dl_abs = now + p->dl_deadline;
+  }
+  if (p->status == proc::proc_status::RUNNABLE) {
+    enqueue(p, p->cpu);
+  }
+  p->lock.release();
+}
+
+auto charge_dl(struct proc::process *p) -> void {
+  auto ran = r_time() - p->run_start;
+  p->dl_budget = ran < p->dl_budget ? p->dl_budget - ran : 0;
+  if (p->status == proc::proc_status::ZOMBIE) {
+    dl_release(p);
+  } else if (p->dl_budget == 0) {
+    throttle(p);
+  }
+}
+
+// p is leaving the cpu, account the time it ran and demote it when
+// its allotment at this level is spent.
+auto charge(struct proc::process *p) -> void {
+  auto &rq = runqueues[proc::cpuid()];
+  rq.curr_level = NLEVEL;
+  rq.curr_deadline = ~0ULL;
+  if (is_dl(p)) {
+    charge_dl(p);
+    return;
+  }
+
+  p->slice_used += r_time() - p->run_start;
+  if (p->slice_used >= quantum(p)) {
+    if (p->level + 1 < NLEVEL) {
+      ++p->level;
+    }
+    p->slice_used = 0;
+  }
+}
+
+// the slice of the running p ran out. when nothing else is queued on
+// this hart, account it as a switch to itself and return the new slice
+// end, otherwise 0 and the caller preempts.
+auto extend(struct proc::process *p) -> uint64_t {
+  if (is_dl(p) ||
+      __atomic_load_n(&runqueues[proc::cpuid()].nr, __ATOMIC_RELAXED) != 0) {
+    return 0;
+  }
+  p->lock.acquire();
+  charge(p);
+  auto end = dispatch(p);
+  p->lock.release();
+  return end;
+}
+
+auto need_resched() -> bool { return runqueues[proc::cpuid()].need_resched; }
+
+// only root may raise its priority. -1 is a valid niceness, so the
+// result is only whether the change was allowed.
+auto nice(struct proc::process *p, int inc) -> bool {
+  p->lock.acquire();
+  auto n = p->nice + inc;
+  if (inc < 0 && p->user->uid != proc::ROOT_ID) {
+    p->lock.release();
+    return false;
+  }
+  if (n < NICE_MIN) {
+    n = NICE_MIN;
+  }
+  if (n > NICE_MAX) {
+    n = NICE_MAX;
+  }
+  p->nice = static_cast<int8_t>(n);
+  if (home_level(n) > p->level) {
+    p->level = home_level(n);
+    p->slice_used = 0;
+  }
+  p->lock.release();
+  return true;
+}
+
+// restrict p to the harts in mask. a queued process is moved right away,
+// a running one when it next gives up the hart. p->lock must be held.
+auto set_affinity(struct proc::process *p, uint32_t mask) -> int {
+  if ((mask & __atomic_load_n(&online_mask, __ATOMIC_ACQUIRE)) == 0) {
+    return -1;
+  }
+  // a deadline process stays on the hart its bandwidth is reserved on
+  if (is_dl(p) && (mask & (1U << p->cpu)) == 0) {
+    return -1;
+  }
+  p->affinity = mask;
+  // balance may be moving p right now, so p->cpu is not worth checking
+  // before remove has it off its queue. enqueue then picks an allowed
+  // hart, or puts it back on the same one.
+  if (p->status == proc::proc_status::RUNNABLE && remove(p)) {
+    enqueue(p, p->cpu);
+  }
+  return 0;
+}
+
+// make p a deadline process, or an mlfq one again when runtime is 0.
+// times are in r_time() cycles. admission picks the allowed hart with
+// the most bandwidth left, p's current reservation counts as free.
+// like a lower niceness, only root may reserve more than p already has.
+// p->lock must be held.
+auto set_deadline(struct proc::process *p, uint64_t runtime, uint64_t deadline,
+                  uint64_t period) -> int {
+  if (p->dl_throttled) {
+    return -1;
+  }
+  uint64_t bw{0};
+  if (runtime != 0) {
+    if (runtime < DL_RUNTIME_MIN || runtime > deadline || deadline > period ||
+        period > DL_PERIOD_MAX) {
+      return -1;
+    }
+    bw = (runtime << DL_BW_SHIFT) / period;
+  }
+  if (bw > p->dl_bw && proc::curr_proc()->user->uid != proc::ROOT_ID) {
+    return -1;
+  }
+
+  dl_lock.acquire();
+  auto cpu = proc::NCPU;
+  if (runtime != 0) {
+    auto mask = p->affinity & __atomic_load_n(&online_mask, __ATOMIC_ACQUIRE);
+    uint64_t best{0};
+    for (uint32_t i{0}; i < proc::NCPU; ++i) {
+      if ((mask & (1U << i)) == 0) {
+        continue;
+      }
+      auto used = runqueues[i].dl_bw;
+      if (is_dl(p) && p->cpu == i) {
+        used -= p->dl_bw;
+      }
+      if (used + bw <= DL_BW_LIMIT && DL_BW_LIMIT - used >= best) {
+        best = DL_BW_LIMIT - used;
+        cpu = i;
+      }
+    }
+    if (cpu == proc::NCPU) {
+      dl_lock.release();
+      return -1;
+    }
+  }
+
+  auto queued = p->status == proc::proc_status::RUNNABLE && remove(p);
+  if (is_dl(p)) {
+    runqueues[p->cpu].dl_bw -= p->dl_bw;
+  }
+  p->dl_runtime = runtime;
+  p->dl_deadline = deadline;
+  p->dl_period = period;
+  p->dl_bw = bw;
+  if (runtime != 0) {
+    runqueues[cpu].dl_bw += bw;
+    p->cpu = cpu;
+    p->dl_abs = r_time() + deadline;
+    p->dl_budget = runtime;
+  } else {
+    reset(p);
+  }
+  // a running p starts the new class with nothing charged yet, rather
+  // than billing its whole mlfq slice against the fresh budget
+  p->run_start = r_time();
+  dl_lock.release();
+
+  if (queued) {
+    enqueue(p, p->cpu);
+  }
+  return 0;
+}
+}  // namespace sched
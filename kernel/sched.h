@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+
+#include "lock.h"
+#include "timer.h"
+
+namespace proc {
+struct process;
+}  // namespace proc
+
+namespace sched {
+// multi-level feedback queue. a process starts at its home level, is
+// demoted once it has used up the quantum of its level (counted across
+// sleeps, so yielding early does not help) and every BOOST_INTERVAL
+// everything goes back to the top. quanta are in r_time() cycles.
+constexpr uint32_t NLEVEL{4};
+constexpr uint64_t QUANTUM[NLEVEL]{100000, 200000, 400000, 800000};
+constexpr uint64_t BOOST_INTERVAL{10000000};
+
+// how often a hart compares its queue with the busiest one
+constexpr uint64_t BALANCE_INTERVAL{1000000};
+
+// hart mask a process may run on
+constexpr uint32_t ALL_HARTS{~0U};
+
+constexpr int NICE_MIN{-20};
+constexpr int NICE_MAX{19};
+
+// deadline class. a process admitted with (runtime, deadline, period)
+// gets runtime cycles within deadline cycles of the start of every
+// period. deadline processes are pinned to the hart they were admitted
+// on and always run before mlfq ones, earliest absolute deadline first.
+// once the budget of a period is used up the process is throttled until
+// the next one. the admitted runtime/period of one hart, in units of
+// 1 << DL_BW_SHIFT, may not go past DL_BW_LIMIT.
+constexpr uint32_t DL_BW_SHIFT{20};
+constexpr uint64_t DL_BW_LIMIT{(95ULL << DL_BW_SHIFT) / 100};
+constexpr uint64_t DL_RUNTIME_MIN{timer::JIFFY / 10};
+constexpr uint64_t DL_PERIOD_MAX{1000 * timer::JIFFY};
+
+// one queue of RUNNABLE processes per level per hart, linked through
+// process::rq_next. lock order: process lock, then runqueue lock.
+struct runqueue {
+  class lock::spinlock lock{"runqueue"};
+  struct proc::process *head[NLEVEL];
+  struct proc::process *tail[NLEVEL];
+  uint32_t bitmap;  // bit n set: level n is not empty
+  uint32_t nr;
+  uint64_t epoch;  // boost period last applied
+  uint32_t curr_level{NLEVEL};  // level of the running process
+  uint64_t curr_deadline{~0ULL};  // of the running process, if it has one
+  struct proc::process *dl_head;  // deadline processes by absolute deadline
+  uint64_t dl_bw;  // admitted bandwidth, under dl_lock
+  bool need_resched;  // something better than curr_level was queued
+  uint64_t next_balance;
+};
+
+auto online(uint32_t cpu) -> void;
+auto online_harts() -> uint32_t;
+auto set_idle(uint32_t cpu, bool idle) -> void;
+auto select_cpu(uint32_t mask) -> uint32_t;
+auto enqueue(struct proc::process *p, uint32_t cpu) -> void;
+auto dequeue(uint32_t cpu) -> struct proc::process *;
+auto balance(uint32_t cpu) -> void;
+auto dispatch(struct proc::process *p) -> uint64_t;
+auto charge(struct proc::process *p) -> void;
+auto extend(struct proc::process *p) -> uint64_t;
+auto need_resched() -> bool;
+auto init_proc(struct proc::process *p, int nice, uint32_t affinity) -> void;
+auto nice(struct proc::process *p, int inc) -> bool;
+auto set_affinity(struct proc::process *p, uint32_t mask) -> int;
+auto set_deadline(struct proc::process *p, uint64_t runtime, uint64_t deadline,
+                  uint64_t period) -> int;
+}  // namespace sched
@@ -30,13 +30,38 @@ extern auto sys_mkdir() -> uint64_t;
 extern auto sys_close() -> uint64_t;
 extern auto sys_setuid() -> uint64_t;
 extern auto sys_setgid() -> uint64_t;
+extern auto sys_readv() -> uint64_t;
+extern auto sys_writev() -> uint64_t;
+extern auto sys_sendfile() -> uint64_t;
+extern auto sys_splice() -> uint64_t;
+extern auto sys_poll() -> uint64_t;
+extern auto sys_epoll_create() -> uint64_t;
+extern auto sys_epoll_ctl() -> uint64_t;
+extern auto sys_epoll_wait() -> uint64_t;
+extern auto sys_fcntl() -> uint64_t;
+extern auto sys_uring_setup() -> uint64_t;
+extern auto sys_uring_enter() -> uint64_t;
+extern auto sys_vmsplice() -> uint64_t;
+extern auto sys_nice() -> uint64_t;
+extern auto sys_sched_setaffinity() -> uint64_t;
+extern auto sys_sched_getaffinity() -> uint64_t;
+extern auto sys_clone() -> uint64_t;
+extern auto sys_futex() -> uint64_t;
+extern auto sys_thread_exit() -> uint64_t;
+extern auto sys_sched_setdeadline() -> uint64_t;
+extern auto sys_lockstat() -> uint64_t;
 
 
 static uint64_t (*syscalls[])(void) = {
     sys_fork,  sys_exit,   sys_wait,  sys_pipe,  sys_read,   sys_kill,
     sys_exec,  sys_fstat,  sys_chdir, sys_dup,   sys_getpid, sys_sbrk,
     sys_sleep, sys_uptime, sys_open,  sys_write, sys_mknod,  sys_unlink,
-    sys_link,  sys_mkdir,  sys_close, sys_setuid, sys_setgid,
+    sys_link,  sys_mkdir,  sys_close, sys_setuid, sys_setgid, sys_readv,
+    sys_writev, sys_sendfile, sys_splice, sys_poll, sys_epoll_create,
+    sys_epoll_ctl, sys_epoll_wait, sys_fcntl, sys_uring_setup,
+    sys_uring_enter, sys_vmsplice, sys_nice, sys_sched_setaffinity,
+    sys_sched_getaffinity, sys_clone, sys_futex, sys_thread_exit,
+    sys_sched_setdeadline, sys_lockstat,
 };
 
 auto syscall() -> void {
@@ -25,9 +25,31 @@ constexpr uint32_t SYS_mkdir{19};
 constexpr uint32_t SYS_close{20};
 constexpr uint32_t SYS_setuid{21};
 constexpr uint32_t SYS_setgid{22};
+constexpr uint32_t SYS_readv{23};
+constexpr uint32_t SYS_writev{24};
+constexpr uint32_t SYS_sendfile{25};
+constexpr uint32_t SYS_splice{26};
+constexpr uint32_t SYS_poll{27};
+constexpr uint32_t SYS_epoll_create{28};
+constexpr uint32_t SYS_epoll_ctl{29};
+constexpr uint32_t SYS_epoll_wait{30};
+constexpr uint32_t SYS_fcntl{31};
+constexpr uint32_t SYS_uring_setup{32};
+constexpr uint32_t SYS_uring_enter{33};
+constexpr uint32_t SYS_vmsplice{34};
+constexpr uint32_t SYS_nice{35};
+constexpr uint32_t SYS_sched_setaffinity{36};
+constexpr uint32_t SYS_sched_getaffinity{37};
+constexpr uint32_t SYS_clone{38};
+constexpr uint32_t SYS_futex{39};
+constexpr uint32_t SYS_thread_exit{40};
+constexpr uint32_t SYS_sched_setdeadline{41};
+constexpr uint32_t SYS_lockstat{42};
 
 auto fetch_addr(uint64_t addr, uint64_t *ip) -> bool;
 auto fetch_str(uint64_t addr, char *buf, uint32_t len) -> bool;
 auto get_argu(uint32_t index) -> uint64_t;
 auto syscall() -> void;
+auto open(char *path, int mode) -> int;
+auto close(int fd) -> int;
 }  // namespace syscall
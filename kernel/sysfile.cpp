@@ -3,20 +3,29 @@
 #include <fmt>
 
 #include "arch/riscv.h"
+#include "fdtable.h"
 #include "file.h"
 #include "fs.h"
+#include "futex.h"
+#include "ipi.h"
 #include "kernel/fs"
 #include "loader.h"
+#include "lock.h"
 #include "log.h"
 #include "pipe.h"
+#include "poll.h"
 #include "proc.h"
+#include "sched.h"
 #include "syscall.h"
+#include "timer.h"
+#include "uring.h"
 #include "vm.h"
 
 namespace syscall {
 auto fetch_addr(uint64_t addr, uint64_t *ip) -> bool {
   auto *proc = proc::curr_proc();
-  if (addr >= proc->sz || addr + sizeof(uint64_t) > proc->sz) {
+  auto sz = proc->group->sz;
+  if (addr >= sz || addr + sizeof(uint64_t) > sz) {
     return false;
   }
   if (vm::copyin(proc->pagetable, (char *)ip, addr, sizeof(*ip)) == false) {
@@ -84,27 +93,14 @@ auto get_argu(uint32_t index) -> uint64_t {
 }
 
 auto alloc_fd(struct file::file *&f) -> int {
-  auto *p = proc::curr_proc();
-
-  auto fd{0};
-  for (; fd < static_cast<int>(file::NOFILE); ++fd) {
-    if (p->ofile[fd] == nullptr) {
-      p->ofile[fd] = f;
-      return fd;
-    }
-  }
-
-  return -1;
+  return file::fd_install(proc::curr_proc()->group->fdt, f);
 }
 
 auto get_fd(uint32_t argu_no, struct file::file *&f) -> int {
   struct file::file *tf = nullptr;
 
   int fd = static_cast<int>(get_argu(argu_no));
-  if (fd < 0 || fd >= static_cast<int>(file::NOFILE)) {
-    return -1;
-  }
-  tf = proc::curr_proc()->ofile[fd];
+  tf = file::fd_get(proc::curr_proc()->group->fdt, fd);
   if (tf == nullptr) {
     return -1;
   }
@@ -112,6 +108,12 @@ auto get_fd(uint32_t argu_no, struct file::file *&f) -> int {
   return fd;
 }
 
+// drop what get_fd took and pass rs through
+static inline auto put_fd(struct file::file *f, uint64_t rs) -> uint64_t {
+  file::close(f);
+  return rs;
+}
+
 auto create(char *path, int type, int16_t major, int16_t minor)
     -> struct file::inode * {
   char name[fs::DIRSIZ];
@@ -254,6 +256,31 @@ auto sys_exit() -> uint64_t {
   return 0;
 }
 
+auto sys_thread_exit() -> uint64_t {
+  proc::thread_exit(static_cast<int>(get_argu(0)));
+  return 0;
+}
+
+auto sys_clone() -> uint64_t {
+  return proc::clone(get_argu(0), get_argu(1), get_argu(2));
+}
+
+auto sys_futex() -> uint64_t {
+  auto uaddr = get_argu(0);
+  auto op = static_cast<int>(get_argu(1));
+  auto val = static_cast<uint32_t>(get_argu(2));
+  auto *pagetable = proc::curr_proc()->pagetable;
+
+  switch (op) {
+    case futex::FUTEX_WAIT:
+      return futex::wait(pagetable, uaddr, val);
+    case futex::FUTEX_WAKE:
+      return futex::wake(pagetable, uaddr, val);
+    default:
+      return -1;
+  }
+}
+
 auto sys_wait() -> uint64_t {
   uint64_t p = get_argu(0);
   return proc::wait(p);
@@ -266,12 +293,18 @@ auto sys_pipe() -> uint64_t {
   auto *p = proc::curr_proc();
 
   uint64_t fdarray = get_argu(0);
+  auto flags = static_cast<uint32_t>(get_argu(1));
+  if ((flags & ~file::O_NONBLOCK) != 0) {
+    return -1;
+  }
   if (file::pipealloc(&rf, &wf) < 0) {
     return -1;
   }
+  rf->flags = flags;
+  wf->flags = flags;
   fd0 = -1;
   if ((fd0 = alloc_fd(rf)) < 0 || (fd1 = alloc_fd(wf)) < 0) {
-    if (fd0 >= 0) p->ofile[fd0] = 0;
+    if (fd0 >= 0) file::fd_remove(p->group->fdt, fd0);
     file::close(rf);
     file::close(wf);
     return -1;
@@ -279,8 +312,8 @@ auto sys_pipe() -> uint64_t {
   if (vm::copyout(p->pagetable, fdarray, (char *)&fd0, sizeof(fd0)) == false ||
       vm::copyout(p->pagetable, fdarray + sizeof(fd0), (char *)&fd1,
                   sizeof(fd1)) == false) {
-    p->ofile[fd0] = nullptr;
-    p->ofile[fd1] = nullptr;
+    file::fd_remove(p->group->fdt, fd0);
+    file::fd_remove(p->group->fdt, fd1);
     file::close(rf);
     file::close(wf);
     return -1;
@@ -297,7 +330,7 @@ auto sys_read() -> uint64_t {
     return -1;
   }
 
-  return file::read(f, addr, size);
+  return put_fd(f, file::read(f, addr, size));
 }
 
 auto sys_kill() -> uint64_t {
@@ -312,7 +345,7 @@ auto sys_fstat() -> uint64_t {
   if (get_fd(0, f) == -1) {
     return -1;
   }
-  return file::stat(f, st);
+  return put_fd(f, file::stat(f, st));
 }
 
 auto sys_chdir() -> uint64_t {
@@ -338,43 +371,38 @@ auto sys_chdir() -> uint64_t {
     return -1;
   }
   fs::iunlock(ip);
-  fs::iput(p->cwd);
+  auto *g = p->group;
+  g->lock.acquire();
+  auto *old = g->cwd;
+  g->cwd = ip;
+  g->lock.release();
+  fs::iput(old);
   log::end_op();
-  p->cwd = ip;
   return 0;
 }
 
-auto fd_alloc(struct file::file *&f) -> int {
-  auto *p = proc::curr_proc();
-  for (int fd = 0; fd < static_cast<int>(file::NOFILE); ++fd) {
-    if (p->ofile[fd] == nullptr) {
-      p->ofile[fd] = f;
-      return fd;
-    }
-  }
-  return -1;
-}
-
 auto sys_dup() -> uint64_t {
   struct file::file *f = nullptr;
 
+  // the new descriptor keeps the reference get_fd took
   if (get_fd(0, f) < 0) {
     return -1;
   }
-  auto fd = fd_alloc(f);
+  auto fd = alloc_fd(f);
   if (fd < 0) {
+    file::close(f);
     return -1;
   }
-
-  file::dup(f);
   return fd;
 }
 
-auto sys_getpid() -> uint64_t { return proc::curr_proc()->pid; }
+auto sys_getpid() -> uint64_t {
+  return proc::curr_proc()->group->leader->pid;
+}
 
 auto sys_sbrk() -> uint64_t {
   int n = static_cast<int>(get_argu(0));
-  auto sz = proc::curr_proc()->sz;
+  auto sz = proc::curr_proc()->group->sz;
 
   if (proc::grow(n) < 0) {
     return -1;
@@ -383,18 +411,93 @@ auto sys_sbrk() -> uint64_t {
   return sz;
 }
 
-auto sys_sleep() -> uint64_t { return 0; }
-auto sys_uptime() -> uint64_t { return 0; }
+auto sys_sleep() -> uint64_t {
+  auto n = static_cast<int>(get_argu(0));
+  if (n < 0) {
+    return -1;
+  }
+  return timer::sleep(n);
+}
 
-auto sys_open() -> uint64_t {
-  char path[file::MAXPATH]{};
-  int mode = static_cast<int>(get_argu(1));
+auto sys_uptime() -> uint64_t { return timer::uptime(); }
 
-  uint64_t addr = get_argu(0);
-  if (fetch_str(addr, path, file::MAXPATH) == false) {
+// returns 20 - niceness like Linux, a negative niceness would otherwise
+// look like an error code to ulibc
+auto sys_nice() -> uint64_t {
+  auto *p = proc::curr_proc();
+  if (!sched::nice(p, static_cast<int>(get_argu(0)))) {
+    return -1;
+  }
+  return sched::NICE_MAX + 1 - p->nice;
+}
+
+// pid 0 is the caller. returned locked, nullptr when there is no such
+// process or the caller may not change it.
+auto sched_target(uint32_t pid) -> struct proc::process * {
+  auto *cp = proc::curr_proc();
+  auto *p = proc::find(pid == 0 ? cp->pid : pid);
+  if (p != nullptr && p != cp && cp->user->uid != proc::ROOT_ID &&
+      cp->user->uid != p->user->uid) {
+    p->lock.release();
+    return nullptr;
+  }
+  return p;
+}
+
+auto sys_sched_setaffinity() -> uint64_t {
+  auto *p = sched_target(static_cast<uint32_t>(get_argu(0)));
+  if (p == nullptr) {
+    return -1;
+  }
+  auto mask = static_cast<uint32_t>(get_argu(1));
+  auto rs = sched::set_affinity(p, mask);
+  p->lock.release();
+  // move off a hart that is no longer allowed
+  if (rs == 0 && p == proc::curr_proc() &&
+      (mask & (1U << proc::cpuid())) == 0) {
+    proc::yield();
+  }
+  return rs;
+}
+
+auto sys_sched_getaffinity() -> uint64_t {
+  auto *p = sched_target(static_cast<uint32_t>(get_argu(0)));
+  if (p == nullptr) {
+    return -1;
+  }
+  uint64_t mask = p->affinity;
+  p->lock.release();
+  return mask;
+}
+
+// runtime, deadline and period in microseconds, runtime 0 goes back to
+// the normal class. only root may reserve bandwidth.
+auto sys_sched_setdeadline() -> uint64_t {
+  constexpr uint64_t CYCLES_PER_US{timer::JIFFY / 1000};
+  auto runtime = get_argu(1);
+  auto deadline = get_argu(2);
+  auto period = get_argu(3);
+  constexpr uint64_t MAX_US{sched::DL_PERIOD_MAX / CYCLES_PER_US};
+  if (runtime > MAX_US || deadline > MAX_US || period > MAX_US) {
+    return -1;
+  }
+  auto *cp = proc::curr_proc();
+  auto *p = sched_target(static_cast<uint32_t>(get_argu(0)));
+  if (p == nullptr) {
     return -1;
   }
+  auto rs = sched::set_deadline(p, runtime * CYCLES_PER_US,
+                                deadline * CYCLES_PER_US,
+                                period * CYCLES_PER_US);
+  p->lock.release();
+  // get onto the reserved hart and the deadline queue right away
+  if (rs == 0 && p == cp) {
+    proc::yield();
+  }
+  return rs;
+}
 
+auto open(char *path, int mode) -> int {
   log::begin_op();
 
   struct file::inode *ip = nullptr;
@@ -469,6 +572,7 @@ auto sys_open() -> uint64_t {
   f->ip = ip;
   f->readable = !(mode & file::O_WRONLY);
   f->writable = (mode & file::O_WRONLY) || (mode & file::O_RDWR);
+  f->flags = mode & file::O_NONBLOCK;
 
   if ((mode & file::O_TRUNC) && ip->type == file::T_FILE) {
     fs::itrunc(ip);
@@ -480,6 +584,17 @@ auto sys_open() -> uint64_t {
   return fd;
 }
 
+auto sys_open() -> uint64_t {
+  char path[file::MAXPATH]{};
+  int mode = static_cast<int>(get_argu(1));
+
+  uint64_t addr = get_argu(0);
+  if (fetch_str(addr, path, file::MAXPATH) == false) {
+    return -1;
+  }
+  return open(path, mode);
+}
+
 auto sys_write() -> uint64_t {
   uint64_t addr = get_argu(1);
   int size = static_cast<int>(get_argu(2));
@@ -489,8 +604,221 @@ auto sys_write() -> uint64_t {
     return -1;
   }
 
-  return file::write(f, addr, size);
+  return put_fd(f, file::write(f, addr, size));
+}
+auto fetch_iovec(uint64_t addr, int iovcnt, struct file::iovec *iov) -> bool {
+  if (iovcnt < 0 || iovcnt > static_cast<int>(file::IOV_MAX)) {
+    return false;
+  }
+  auto *p = proc::curr_proc();
+  if (vm::copyin(p->pagetable, (char *)iov, addr,
+                 sizeof(struct file::iovec) * iovcnt) == false) {
+    return false;
+  }
+  // the byte counts are summed into an int
+  uint64_t total{0};
+  for (auto i{0}; i < iovcnt; ++i) {
+    total += iov[i].iov_len;
+    if (iov[i].iov_len > 0x7fffffffU || total > 0x7fffffffU) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto sys_readv() -> uint64_t {
+  struct file::iovec iov[file::IOV_MAX]{};
+  uint64_t addr = get_argu(1);
+  int iovcnt = static_cast<int>(get_argu(2));
+
+  struct file::file *f = nullptr;
+  if (get_fd(0, f) == -1) {
+    return -1;
+  }
+  if (fetch_iovec(addr, iovcnt, iov) == false) {
+    return put_fd(f, -1);
+  }
+
+  return put_fd(f, file::readv(f, iov, iovcnt));
+}
+
+auto sys_writev() -> uint64_t {
+  struct file::iovec iov[file::IOV_MAX]{};
+  uint64_t addr = get_argu(1);
+  int iovcnt = static_cast<int>(get_argu(2));
+
+  struct file::file *f = nullptr;
+  if (get_fd(0, f) == -1) {
+    return -1;
+  }
+  if (fetch_iovec(addr, iovcnt, iov) == false) {
+    return put_fd(f, -1);
+  }
+
+  return put_fd(f, file::writev(f, iov, iovcnt));
+}
+auto sys_vmsplice() -> uint64_t {
+  struct file::iovec iov[file::IOV_MAX]{};
+  uint64_t addr = get_argu(1);
+  int iovcnt = static_cast<int>(get_argu(2));
+  auto flags = static_cast<uint32_t>(get_argu(3));
+
+  struct file::file *f = nullptr;
+  if (get_fd(0, f) == -1) {
+    return -1;
+  }
+  if (fetch_iovec(addr, iovcnt, iov) == false) {
+    return put_fd(f, -1);
+  }
+
+  auto rs = file::vmsplice(f, iov, iovcnt, flags);
+  file::close(f);
+  // gifted pages turned read-only under the other threads
+  if ((flags & file::SPLICE_F_GIFT) && proc::curr_proc()->group->ref > 1) {
+    ipi::tlb_shootdown(sched::online_harts());
+  }
+  return rs;
+}
+
+auto sendfile(struct file::file *out, struct file::file *in, uint64_t offp,
+              int count) -> int {
+  if (count < 0) {
+    return -1;
+  }
+  if (offp == 0) {
+    return file::sendfile(out, in, in->off, count);
+  }
+
+  // an explicit offset leaves the file offset of in untouched
+  auto *p = proc::curr_proc();
+  uint64_t off = 0;
+  if (vm::copyin(p->pagetable, (char *)&off, offp, sizeof(off)) == false) {
+    return -1;
+  }
+  auto off32 = static_cast<uint32_t>(off);
+  auto rs = file::sendfile(out, in, off32, count);
+  off = off32;
+  if (vm::copyout(p->pagetable, offp, (char *)&off, sizeof(off)) == false) {
+    return -1;
+  }
+  return rs;
+}
+
+auto sys_sendfile() -> uint64_t {
+  struct file::file *out = nullptr;
+  struct file::file *in = nullptr;
+  uint64_t offp = get_argu(2);
+  int count = static_cast<int>(get_argu(3));
+
+  if (get_fd(0, out) == -1) {
+    return -1;
+  }
+  if (get_fd(1, in) == -1) {
+    return put_fd(out, -1);
+  }
+  auto rs = sendfile(out, in, offp, count);
+  file::close(in);
+  return put_fd(out, rs);
+}
+
+auto sys_splice() -> uint64_t {
+  struct file::file *in = nullptr;
+  struct file::file *out = nullptr;
+  int len = static_cast<int>(get_argu(4));
+
+  if (get_fd(0, in) == -1) {
+    return -1;
+  }
+  if (get_fd(2, out) == -1) {
+    return put_fd(in, -1);
+  }
+  // explicit offsets are not supported, the file offset is always used
+  auto rs{-1};
+  if (get_argu(1) == 0 && get_argu(3) == 0 && len >= 0) {
+    rs = file::splice(in, out, len);
+  }
+  file::close(out);
+  return put_fd(in, rs);
+}
+
+auto sys_poll() -> uint64_t {
+  auto ufds = get_argu(0);
+  auto nfds = static_cast<int>(get_argu(1));
+  auto timeout = static_cast<int>(get_argu(2));
+  return poll::poll(ufds, nfds, timeout);
+}
+
+auto sys_epoll_create() -> uint64_t {
+  auto *f = poll::epoll_create();
+  if (f == nullptr) {
+    return -1;
+  }
+  auto fd = alloc_fd(f);
+  if (fd < 0) {
+    file::close(f);
+    return -1;
+  }
+  return fd;
+}
+
+auto sys_epoll_ctl() -> uint64_t {
+  struct file::file *epf = nullptr;
+  struct file::file *f = nullptr;
+  auto op = static_cast<int>(get_argu(1));
+  struct poll::epoll_event ev{};
+
+  if (get_fd(0, epf) == -1) {
+    return -1;
+  }
+  if (epf->type != file::file::FD_EPOLL) {
+    return put_fd(epf, -1);
+  }
+  auto fd = get_fd(2, f);
+  if (fd == -1) {
+    return put_fd(epf, -1);
+  }
+  auto rs{-1};
+  if (op == poll::EPOLL_CTL_DEL ||
+      vm::copyin(proc::curr_proc()->pagetable, (char *)&ev, get_argu(3),
+                 sizeof(ev))) {
+    rs = poll::epoll_ctl(epf->ep, op, fd, f, ev);
+  }
+  file::close(f);
+  return put_fd(epf, rs);
+}
+
+auto sys_epoll_wait() -> uint64_t {
+  struct file::file *epf = nullptr;
+  auto maxevents = static_cast<int>(get_argu(2));
+  auto timeout = static_cast<int>(get_argu(3));
+
+  if (get_fd(0, epf) == -1) {
+    return -1;
+  }
+  if (epf->type != file::file::FD_EPOLL) {
+    return put_fd(epf, -1);
+  }
+  return put_fd(epf, poll::epoll_wait(epf->ep, get_argu(1), maxevents,
+                                      timeout));
+}
+
+auto sys_fcntl() -> uint64_t {
+  struct file::file *f = nullptr;
+  if (get_fd(0, f) == -1) {
+    return -1;
+  }
+  auto rs = file::fcntl(f, static_cast<int>(get_argu(1)), get_argu(2));
+  return put_fd(f, rs);
+}
+
+auto sys_uring_setup() -> uint64_t { return uring::setup(); }
+
+// completions are posted before this returns, so there is nothing to
+// wait for and min_complete (argument 1) is not looked at.
+auto sys_uring_enter() -> uint64_t {
+  return uring::enter(static_cast<uint32_t>(get_argu(0)));
 }
+
 auto sys_mknod() -> uint64_t {
   char path[file::MAXPATH];
 
@@ -541,17 +869,21 @@ auto sys_mkdir() -> uint64_t {
   log::end_op();
   return 0;
 }
-auto sys_close() -> uint64_t {
-  struct file::file *f = nullptr;
-  auto fd = get_fd(0, f);
-  if (fd == -1) {
+auto close(int fd) -> int {
+  auto *p = proc::curr_proc();
+  // one lookup, two threads closing the same fd cannot both get f
+  auto *f = file::fd_remove(p->group->fdt, fd);
+  if (f == nullptr) {
     return -1;
   }
-  proc::curr_proc()->ofile[fd] = nullptr;
   file::close(f);
   return 0;
 }
 
+auto sys_close() -> uint64_t {
+  return close(static_cast<int>(get_argu(0)));
+}
+
 auto sys_setuid() -> uint64_t {
   auto id = static_cast<uint32_t>(get_argu(0));
   auto *p = proc::curr_proc();
@@ -569,4 +901,12 @@ auto sys_setgid() -> uint64_t {
   return 0;
 }
 
+// copies up to n lock records to the user buffer and returns how many
+// named locks there are, -1 when the kernel was built without LOCKSTAT
+auto sys_lockstat() -> uint64_t {
+  auto addr = get_argu(0);
+  auto n = static_cast<uint32_t>(get_argu(1));
+  return lock::export_stats(proc::curr_proc()->pagetable, addr, n);
+}
+
 }  // namespace syscall
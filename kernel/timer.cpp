@@ -0,0 +1,264 @@
+#include "timer.h"
+
+#include <cstdint>
+#include <fmt>
+
+#ifndef ARCH_RISCV
+#include "arch/riscv.h"
+#define ARCH_RISCV
+#endif
+
+#include "lock.h"
+#include "proc.h"
+
+namespace timer {
+// hierarchical timer wheel, one per hart. level 0 has one slot per
+// jiffy, every level above covers WHEEL_SIZE slots of the one below and
+// is cascaded down whenever the index of the level below wraps.
+constexpr uint32_t WHEEL_BITS{6};
+constexpr uint32_t WHEEL_SIZE{1U << WHEEL_BITS};
+constexpr uint32_t WHEEL_MASK{WHEEL_SIZE - 1};
+constexpr uint32_t WHEEL_LEVELS{4};
+constexpr uint64_t WHEEL_SPAN{1ULL << (WHEEL_BITS * WHEEL_LEVELS)};
+
+enum : uint8_t { IDLE, PENDING, FIRING };
+
+struct wheel {
+  class lock::spinlock lock{"timer"};
+  uint64_t clk;  // next jiffy to be processed
+  struct timer *slot[WHEEL_LEVELS][WHEEL_SIZE];
+  uint32_t count[WHEEL_LEVELS];
+};
+
+struct wheel wheels[proc::NCPU];
+uint64_t boot_jiffies;
+
+auto init() -> void {
+  boot_jiffies = jiffies();
+  for (auto &w : wheels) {
+    w.clk = boot_jiffies;
+  }
+}
+
+auto jiffies() -> uint64_t { return r_time() / JIFFY; }
+
+auto uptime() -> uint64_t { return jiffies() - boot_jiffies; }
+
+auto boot() -> uint64_t { return boot_jiffies; }
+
+auto level_of(struct wheel &w, struct timer **slot) -> uint32_t {
+  return static_cast<uint32_t>(slot - &w.slot[0][0]) / WHEEL_SIZE;
+}
+
+auto enqueue(struct wheel &w, struct timer *t) -> void {
+  auto e = t->expires < w.clk ? w.clk : t->expires;
+  if (e - w.clk >= WHEEL_SPAN) {
+    e = w.clk + WHEEL_SPAN - 1;
+  }
+  auto delta = e - w.clk;
+
+  uint32_t level{0};
+  while (level < WHEEL_LEVELS - 1 &&
+         delta >= (1ULL << (WHEEL_BITS * (level + 1)))) {
+    ++level;
+  }
+  auto **slot = &w.slot[level][(e >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+  t->slot = slot;
+  t->prev = nullptr;
+  t->next = *slot;
+  if (*slot != nullptr) {
+    (*slot)->prev = t;
+  }
+  *slot = t;
+  ++w.count[level];
+}
+
+auto detach(struct wheel &w, struct timer *t) -> void {
+  if (t->prev != nullptr) {
+    t->prev->next = t->next;
+  } else {
+    *t->slot = t->next;
+  }
+  if (t->next != nullptr) {
+    t->next->prev = t->prev;
+  }
+  --w.count[level_of(w, t->slot)];
+  t->next = t->prev = nullptr;
+  t->slot = nullptr;
+}
+
+auto add(struct timer &t, uint64_t expires) -> void {
+  lock::push_off();
+  auto id = proc::cpuid();
+  auto &w = wheels[id];
+
+  w.lock.acquire();
+  if (t.state != IDLE) {
+    fmt::panic("timer::add: timer is active");
+  }
+  t.expires = expires;
+  t.cpu = id;
+  t.state = PENDING;
+  enqueue(w, &t);
+  w.lock.release();
+
+  // the new deadline may be earlier than the programmed interrupt
+  if (expires * JIFFY < r_stimecmp()) {
+    w_stimecmp(expires * JIFFY);
+  }
+  lock::pop_off();
+}
+
+// remove t if it is still pending, and wait for its callback if it is
+// running on some hart right now. afterwards t may be reused or freed.
+auto del(struct timer &t) -> bool {
+  while (true) {
+    auto state = __atomic_load_n(&t.state, __ATOMIC_ACQUIRE);
+    if (state == IDLE) {
+      return false;
+    }
+    auto &w = wheels[t.cpu];
+    w.lock.acquire();
+    if (t.state == PENDING) {
+      detach(w, &t);
+      t.state = IDLE;
+      w.lock.release();
+      return true;
+    }
+    w.lock.release();
+  }
+}
+
+auto cascade(struct wheel &w, uint32_t level, uint32_t idx) -> void {
+  auto *t = w.slot[level][idx];
+  w.slot[level][idx] = nullptr;
+  while (t != nullptr) {
+    auto *next = t->next;
+    --w.count[level];
+    enqueue(w, t);
+    t = next;
+  }
+}
+
+auto run() -> void {
+  auto &w = wheels[proc::cpuid()];
+  auto now = jiffies();
+  struct timer *expired{nullptr};
+
+  w.lock.acquire();
+  while (w.clk <= now) {
+    // an idle hart may have slept for a long time, with level 0 empty
+    // jump straight to the next jiffy at which a higher level cascades
+    if (w.count[0] == 0) {
+      uint32_t level{1};
+      while (level < WHEEL_LEVELS && w.count[level] == 0) {
+        ++level;
+      }
+      if (level == WHEEL_LEVELS) {
+        w.clk = now + 1;
+        break;
+      }
+      auto step = 1ULL << (WHEEL_BITS * level);
+      auto next = (w.clk + step - 1) & ~(step - 1);
+      if (next != w.clk) {
+        w.clk = next <= now ? next : now + 1;
+        continue;
+      }
+    }
+
+    auto idx = static_cast<uint32_t>(w.clk & WHEEL_MASK);
+    for (uint32_t level{1}; idx == 0 && level < WHEEL_LEVELS; ++level) {
+      idx = static_cast<uint32_t>((w.clk >> (WHEEL_BITS * level)) &
+                                  WHEEL_MASK);
+      cascade(w, level, idx);
+    }
+
+    auto *t = w.slot[0][w.clk & WHEEL_MASK];
+    while (t != nullptr) {
+      auto *next = t->next;
+      detach(w, t);
+      t->state = FIRING;
+      t->next = expired;
+      expired = t;
+      t = next;
+    }
+    ++w.clk;
+  }
+  w.lock.release();
+
+  // run the callbacks without the wheel lock, they may add timers
+  while (expired != nullptr) {
+    auto *t = expired;
+    expired = t->next;
+    t->fn(t->arg);
+    __atomic_store_n(&t->state, IDLE, __ATOMIC_RELEASE);
+  }
+}
+
+// the r_time() value at which this hart's wheel needs attention next,
+// either a level 0 slot that is due or a cascade of a higher level.
+auto next_event() -> uint64_t {
+  auto &w = wheels[proc::cpuid()];
+  auto rs = ~0ULL;
+
+  w.lock.acquire();
+  if (w.count[0] > 0) {
+    for (uint64_t j = w.clk; j < w.clk + WHEEL_SIZE; ++j) {
+      if (w.slot[0][j & WHEEL_MASK] != nullptr) {
+        rs = j * JIFFY;
+        break;
+      }
+    }
+  }
+  for (uint32_t level{1}; level < WHEEL_LEVELS; ++level) {
+    if (w.count[level] > 0) {
+      auto boundary = ((w.clk + WHEEL_MASK) & ~uint64_t{WHEEL_MASK}) * JIFFY;
+      if (boundary < rs) {
+        rs = boundary;
+      }
+      break;
+    }
+  }
+  w.lock.release();
+  return rs;
+}
+
+struct sleeper {
+  struct proc::process *proc;
+  class lock::spinlock lock{};
+  bool fired{false};
+};
+
+auto sleeper_expire(void *arg) -> void {
+  auto *s = static_cast<struct sleeper *>(arg);
+  s->lock.acquire();
+  s->fired = true;
+  proc::wakeup_proc(s->proc, s);
+  s->lock.release();
+}
+
+// sleep for n jiffies, only this process is touched when it expires
+auto sleep(uint64_t n) -> int {
+  struct sleeper s{};
+  struct timer t{};
+  s.proc = proc::curr_proc();
+  t.fn = sleeper_expire;
+  t.arg = &s;
+
+  auto rs{0};
+  s.lock.acquire();
+  add(t, jiffies() + n);
+  while (s.fired == false) {
+    if (proc::get_killed(s.proc)) {
+      rs = -1;
+      break;
+    }
+    proc::sleep(&s, s.lock);
+  }
+  s.lock.release();
+
+  del(t);
+  return rs;
+}
+}  // namespace timer
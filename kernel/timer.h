@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+namespace timer {
+// wheel resolution, 1ms with the 10MHz timebase of qemu virt
+constexpr uint64_t JIFFY{10000};
+// scheduler time slice, in r_time() cycles
+constexpr uint64_t TICK_INTERVAL{1000000};
+
+struct timer {
+  uint64_t expires;  // in jiffies
+  void (*fn)(void *);
+  void *arg;
+  struct timer *next;
+  struct timer *prev;
+  struct timer **slot;  // wheel slot holding this timer
+  uint32_t cpu;
+  uint8_t state;
+};
+
+auto init() -> void;
+auto jiffies() -> uint64_t;
+auto uptime() -> uint64_t;
+auto boot() -> uint64_t;
+auto add(struct timer &t, uint64_t expires) -> void;
+auto del(struct timer &t) -> bool;
+auto run() -> void;
+auto next_event() -> uint64_t;
+auto sleep(uint64_t n) -> int;
+}  // namespace timer
@@ -6,10 +6,14 @@
 #define ARCH_RISCV
 #endif
 
+#include "fpu.h"
+#include "ipi.h"
 #include "lock.h"
 #include "plic.h"
 #include "proc.h"
+#include "sched.h"
 #include "syscall.h"
+#include "timer.h"
 #include "trap.h"
 #include "uart.h"
 #include "virtio_disk.h"
@@ -20,12 +24,15 @@ extern "C" char trampoline[], uservec[], userret[];
 
 namespace trap {
 
-class lock::spinlock tickslock{};
-uint32_t ticks;
+uint64_t slice_end[proc::NCPU];
 
 auto devintr() -> int;
 
-auto inithart() -> void { w_stvec((uint64_t)kernelvec); }
+auto inithart() -> void {
+  w_stvec((uint64_t)kernelvec);
+  // let user mode read the time csr, the vdata helpers rely on it.
+  w_scounteren(r_scounteren() | 2U);
+}
 
 auto user_trap() -> void {
   if ((r_sstatus() & SSTATUS_SPP) != 0) {
@@ -48,6 +55,15 @@ auto user_trap() -> void {
     syscall::syscall();
   } else if ((which_dev = devintr()) != 0) {
     // ok
+  } else if (r_scause() == 2 && fpu::trap(p)) {
+    // first fp instruction since p was switched in, retry it
+  } else if (r_scause() == 15 && vm::cow_fault(p->pagetable, r_stval())) {
+    // store to a copy-on-write page, other threads may still have the
+    // old page in their tlb
+    if (p->group->ref > 1) {
+      intr_on();
+      ipi::tlb_shootdown(sched::online_harts());
+    }
   } else {
     fmt::print("usertrap(): unexpected scause 0x{x}, sepc=0x{x}, stval=0x{x}\n",
                r_scause(), r_sepc(), r_stval());
@@ -59,7 +75,7 @@ auto user_trap() -> void {
     proc::exit(-1);
   }
 
-  if (which_dev == 2) {
+  if (which_dev == 2 || sched::need_resched()) {
     proc::yield();
   }
 
@@ -89,7 +105,8 @@ auto user_ret() -> void {
   uint64_t satp = MAKE_SATP(p->pagetable);
 
   uint64_t trampoline_userret = vm::TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64_t))trampoline_userret)(satp);
+  ((void (*)(uint64_t, uint64_t))trampoline_userret)(
+      satp, vm::THREAD_TRAPFRAME(p->slot));
 }
 
 extern "C" auto kerneltrap() -> void {
@@ -112,23 +129,56 @@ extern "C" auto kerneltrap() -> void {
     fmt::panic("trap::kerneltrap");
   }
 
-  if (dev == 2 && proc::curr_proc() != nullptr) {
+  if ((dev == 2 || sched::need_resched()) && proc::curr_proc() != nullptr) {
     proc::yield();
+    // the scheduler owns sstatus.FS across a switch
+    sstatus = (sstatus & ~SSTATUS_FS) | (r_sstatus() & SSTATUS_FS);
   }
 
   w_sepc(sepc);
   w_sstatus(sstatus);
 }
 
-void clockintr() {
-  if (proc::cpuid() == 0) {
-    tickslock.acquire();
-    ticks++;
-    proc::wakeup(&ticks);
-    tickslock.release();
+// end of the running process's slice, set by the scheduler from its
+// mlfq quantum right before switching to it.
+auto set_slice(uint64_t end) -> void {
+  auto id = proc::cpuid();
+  slice_end[id] = end;
+  auto next = timer::next_event();
+  w_stimecmp(next < end ? next : end);
+}
+
+// an idle hart only wakes for its next timer, or when another hart
+// kicks it with an ipi.
+auto set_idle() -> void {
+  slice_end[proc::cpuid()] = ~0ULL;
+  w_stimecmp(timer::next_event());
+}
+
+// returns 2 when the time slice of this hart is over, 1 when the
+// interrupt only served the timer wheel. a process with nobody else to
+// run on its hart gets a fresh slice in place instead of a preemption.
+auto clockintr() -> int {
+  auto id = proc::cpuid();
+  auto now = r_time();
+  auto rs{1};
+
+  if (now >= slice_end[id]) {
+    auto *p = proc::curr_proc();
+    auto end = p != nullptr ? sched::extend(p) : 0;
+    if (end != 0) {
+      slice_end[id] = end;
+    } else {
+      slice_end[id] = now + timer::TICK_INTERVAL;
+      rs = 2;
+    }
   }
 
-  w_stimecmp(r_time() + 1000000);
+  timer::run();
+
+  auto next = timer::next_event();
+  w_stimecmp(next < slice_end[id] ? next : slice_end[id]);
+  return rs;
 }
 
 auto devintr() -> int {
@@ -152,8 +202,11 @@ auto devintr() -> int {
     return 1;
   }
   if (scause == 0x8000000000000005L) {
-    clockintr();
-    return 2;
+    return clockintr();
+  }
+  if (scause == 0x8000000000000001L) {
+    ipi::handle();
+    return 1;
   }
   return 0;
 }
@@ -1,6 +1,10 @@
 #pragma once
+#include <cstdint>
+
 namespace trap {
 auto init() -> void;
 auto inithart() -> void;
 auto user_ret() -> void;
+auto set_slice(uint64_t end) -> void;
+auto set_idle() -> void;
 }  // namespace trap
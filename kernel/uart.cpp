@@ -22,7 +22,7 @@ constexpr uint64_t LSR{5};
 // constexpr uint64_t LSR_RX_READY {1<<0};
 constexpr uint64_t LSR_TX_IDLE{1U << 5U};
 
-class lock::spinlock uart_tx_lock{};
+class lock::spinlock uart_tx_lock{"uart"};
 
 constexpr uint32_t UART_TX_BUF_SIZE{32};
 char uart_tx_buf[UART_TX_BUF_SIZE];
@@ -88,6 +88,22 @@ auto putc(char c) -> void {
   uart_tx_lock.release();
 }
 
+// like putc, but fails instead of sleeping when the buffer is full.
+auto try_putc(char c) -> bool {
+  uart_tx_lock.acquire();
+
+  if (uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE) {
+    uart_tx_lock.release();
+    return false;
+  }
+
+  uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = c;
+  ++uart_tx_w;
+  start();
+  uart_tx_lock.release();
+  return true;
+}
+
 auto kputc(char c) -> void {
   lock::push_off();
 
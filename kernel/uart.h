@@ -4,6 +4,7 @@
 namespace uart {
 auto init() -> void;
 auto putc(char c) -> void;
+auto try_putc(char c) -> bool;
 auto kputc(char c) -> void;
 auto intr() -> void;
 auto getc() -> std::optional<char>;
@@ -0,0 +1,145 @@
+#include "uring.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "fdtable.h"
+#include "file.h"
+#include "proc.h"
+#include "syscall.h"
+#include "vm.h"
+
+namespace uring {
+static_assert(sizeof(struct sqring) <= PGSIZE);
+static_assert(sizeof(struct cqring) <= PGSIZE);
+
+// one ring per process, every thread sees it at the same address
+auto setup() -> uint64_t {
+  auto *p = proc::curr_proc();
+  auto *g = p->group;
+
+  auto opt_sq = vm::kalloc();
+  if (!opt_sq.has_value()) {
+    return -1;
+  }
+  auto opt_cq = vm::kalloc();
+  if (!opt_cq.has_value()) {
+    vm::kfree(opt_sq.value());
+    return -1;
+  }
+  auto *sq = (struct sqring *)opt_sq.value();
+  auto *cq = (struct cqring *)opt_cq.value();
+  std::memset(sq, 0, PGSIZE);
+  std::memset(cq, 0, PGSIZE);
+  sq->mask = SQ_ENTRIES - 1;
+  cq->mask = CQ_ENTRIES - 1;
+
+  g->lock.acquire();
+  auto ok = g->sq == nullptr &&
+            vm::map_pages(p->pagetable, vm::URING, (uint64_t)sq, PGSIZE,
+                          PTE_R | PTE_W | PTE_U);
+  if (ok && vm::map_pages(p->pagetable, vm::URING + PGSIZE, (uint64_t)cq,
+                          PGSIZE, PTE_R | PTE_W | PTE_U) == false) {
+    vm::uvm_unmap(p->pagetable, vm::URING, 1, false);
+    ok = false;
+  }
+  if (ok) {
+    g->sq = sq;
+    g->cq = cq;
+  }
+  g->lock.release();
+
+  if (!ok) {
+    vm::kfree(sq);
+    vm::kfree(cq);
+    return -1;
+  }
+  return vm::URING;
+}
+
+auto execute(const struct sqe &e) -> int {
+  auto *p = proc::curr_proc();
+  switch (e.opcode) {
+    case OP_NOP:
+      return 0;
+    case OP_READ:
+    case OP_WRITE: {
+      auto *f = file::fd_get(p->group->fdt, e.fd);
+      if (f == nullptr) {
+        return -1;
+      }
+      auto n = static_cast<int>(e.len);
+      auto rs = e.opcode == OP_READ ? file::read(f, e.addr, n)
+                                    : file::write(f, e.addr, n);
+      file::close(f);
+      return rs;
+    }
+    case OP_OPEN: {
+      char path[file::MAXPATH]{};
+      if (syscall::fetch_str(e.addr, path, file::MAXPATH) == false) {
+        return -1;
+      }
+      return syscall::open(path, static_cast<int>(e.flags));
+    }
+    case OP_CLOSE:
+      return syscall::close(e.fd);
+    default:
+      return -1;
+  }
+}
+
+// every operation runs to completion before the next one is taken, so
+// completions are posted in submission order and a later entry may use
+// the fd an earlier OP_OPEN produced.
+auto enter(uint32_t to_submit) -> int {
+  auto *p = proc::curr_proc();
+  auto *g = p->group;
+  g->lock.acquire();
+  auto *sq = g->sq;
+  auto *cq = g->cq;
+  g->lock.release();
+  if (sq == nullptr) {
+    return -1;
+  }
+
+  auto head = sq->head;
+  auto tail = __atomic_load_n(&sq->tail, __ATOMIC_ACQUIRE);
+  auto done{0U};
+  while (done < to_submit && head != tail) {
+    auto ctail = cq->tail;
+    if (ctail - __atomic_load_n(&cq->head, __ATOMIC_ACQUIRE) >= CQ_ENTRIES) {
+      break;
+    }
+
+    // copy it out first, user space may scribble over the slot.
+    struct sqe e = sq->entries[head & (SQ_ENTRIES - 1)];
+    ++head;
+    __atomic_store_n(&sq->head, head, __ATOMIC_RELEASE);
+
+    auto &c = cq->entries[ctail & (CQ_ENTRIES - 1)];
+    c.user_data = e.user_data;
+    c.res = execute(e);
+    c.flags = 0;
+    __atomic_store_n(&cq->tail, ctail + 1, __ATOMIC_RELEASE);
+
+    ++done;
+    if (proc::get_killed(p)) {
+      break;
+    }
+  }
+  return static_cast<int>(done);
+}
+
+// the mapping is torn down with the page table, see free_pagetable().
+// only called once no other thread of g is left.
+auto release(struct proc::group &g) -> void {
+  if (g.sq != nullptr) {
+    vm::kfree(g.sq);
+  }
+  if (g.cq != nullptr) {
+    vm::kfree(g.cq);
+  }
+  g.sq = nullptr;
+  g.cq = nullptr;
+}
+}  // namespace uring
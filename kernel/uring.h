@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+
+namespace proc {
+struct group;
+}  // namespace proc
+
+namespace uring {
+// submission and completion rings shared with user space, each one a
+// page mapped at vm::URING and vm::URING + PGSIZE. user space owns the
+// sq tail and the cq head, the kernel owns the other two indices.
+constexpr uint32_t SQ_ENTRIES{64};
+constexpr uint32_t CQ_ENTRIES{128};
+
+enum : uint8_t { OP_NOP, OP_READ, OP_WRITE, OP_OPEN, OP_CLOSE };
+
+struct sqe {
+  uint8_t opcode;
+  uint8_t pad[3];
+  int32_t fd;
+  uint64_t addr;  // buffer, or path for OP_OPEN
+  uint32_t len;
+  uint32_t flags;  // open mode for OP_OPEN
+  uint64_t user_data;
+};
+
+struct cqe {
+  uint64_t user_data;
+  int32_t res;
+  uint32_t flags;
+};
+
+struct sqring {
+  uint32_t head;
+  uint32_t tail;
+  uint32_t mask;
+  uint32_t pad;
+  struct sqe entries[SQ_ENTRIES];
+};
+
+struct cqring {
+  uint32_t head;
+  uint32_t tail;
+  uint32_t mask;
+  uint32_t pad;
+  struct cqe entries[CQ_ENTRIES];
+};
+
+auto setup() -> uint64_t;
+auto enter(uint32_t to_submit) -> int;
+auto release(struct proc::group &g) -> void;
+}  // namespace uring
@@ -32,7 +32,7 @@ static struct disk {
 
   struct virtio_blk_req ops[NUM]{};
 
-  class lock::spinlock vdisk_lock{};
+  class lock::spinlock vdisk_lock{"virtio_disk"};
 } disk;
 
 auto init() -> void {
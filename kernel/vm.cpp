@@ -19,9 +19,19 @@ extern "C" char etext[];
 namespace vm {
 uint64_t *kernel_pagetable;
 struct {
-  class lock::spinlock lock{};
+  class lock::spinlock lock{"kmem", lock::kind::MCS};
   struct list *freelist{};
+  // mappings per page, pages shared copy-on-write have more than one
+  uint16_t ref[(PHY_END - KERNEL_BASE) / PGSIZE]{};
 } kmem{};
+// serialises copy-on-write pte updates, threads share page tables
+class lock::spinlock cow_lock{"cow"};
+// serialises kernel stack mappings in kernel_pagetable
+class lock::spinlock kstack_lock{"kstack"};
+
+static inline auto page_index(const void *pa) -> uint64_t {
+  return ((uint64_t)pa - KERNEL_BASE) / PGSIZE;
+}
 
 auto kvm_make() -> std::optional<uint64_t *>;
 
@@ -33,6 +43,16 @@ auto kinit() -> void {
 }
 
 auto kfree(void *addr) -> void {
+  kmem.lock.acquire();
+  auto &ref = kmem.ref[page_index(addr)];
+  if (ref > 1) {
+    --ref;
+    kmem.lock.release();
+    return;
+  }
+  ref = 0;
+  kmem.lock.release();
+
   std::memset(addr, 1, PGSIZE);
   auto *tmp = static_cast<struct list *>(addr);
   kmem.lock.acquire();
@@ -46,6 +66,7 @@ auto kalloc() -> std::optional<uint64_t *> {
   auto *tmp = kmem.freelist;
   if (tmp) {
     kmem.freelist = tmp->next;
+    kmem.ref[page_index(tmp)] = 1;
     std::memset((char *)tmp, 5, PGSIZE);  // fill with junk
     auto rs_val = (uint64_t *)(tmp);
     kmem.lock.release();
@@ -55,6 +76,13 @@ auto kalloc() -> std::optional<uint64_t *> {
   return {};
 }
 
+// take another reference on an allocated page, kfree drops it.
+auto kref(void *addr) -> void {
+  kmem.lock.acquire();
+  ++kmem.ref[page_index(addr)];
+  kmem.lock.release();
+}
+
 auto init() -> void {
   auto opt_kpt = kvm_make();
   if (opt_kpt.has_value()) {
@@ -69,6 +97,9 @@ auto kvm_make() -> std::optional<uint64_t *> {
   if (opt_kpt.has_value()) {
     auto *kpt = opt_kpt.value();
     std::memset(kpt, 0, PGSIZE);
+    if (map_pages(kpt, CLINT, CLINT, PGSIZE, PTE_R | PTE_W) == false) {
+      fmt::panic("vm::kvm_make: CLINT");
+    }
     if (map_pages(kpt, UART0, UART0, PGSIZE, PTE_R | PTE_W) == false) {
       fmt::panic("vm::kvm_make: UART0");
     }
@@ -90,7 +121,6 @@ auto kvm_make() -> std::optional<uint64_t *> {
                   PTE_R | PTE_X) == false) {
       fmt::panic("vm::kvm_make: TRAMPOLINE");
     }
-    proc::map_stack(kpt);
     return {kpt};
   }
   return {};
@@ -247,6 +277,25 @@ auto uvm_unmap(uint64_t *pagetable, uint64_t va, uint64_t npages, bool do_free)
   }
 }
 
+// unmap like uvm_unmap but hand the pages to the caller in pa[], 0 for
+// holes, so they can be freed once no tlb refers to them any more.
+auto uvm_detach(uint64_t *pagetable, uint64_t va, uint64_t npages,
+                uint64_t *pa) -> void {
+  for (uint64_t i{0}; i < npages; ++i) {
+    pa[i] = 0;
+    auto opt_pte = walk(pagetable, va + i * PGSIZE, false);
+    if (!opt_pte.has_value() || (*opt_pte.value() & PTE_V) == 0) {
+      continue;
+    }
+    auto *pte = opt_pte.value();
+    if (PTE_FLAGS(*pte) == PTE_V) {
+      fmt::panic("vm::uvm_detach: not a leaf");
+    }
+    pa[i] = PTE2PA(*pte);
+    *pte = 0;
+  }
+}
+
 auto uvm_free(uint64_t *pagetable, uint64_t sz) -> void {
   if (sz > 0) {
     uvm_unmap(pagetable, 0, PG_ROUND_UP(sz) / PGSIZE, true);
@@ -308,6 +357,10 @@ auto uvm_copy(uint64_t *old_pagetable, uint64_t *new_pagetable, uint64_t sz)
 
     auto pa = PTE2PA(*pte);
     auto flags = PTE_FLAGS(*pte);
+    if (flags & PTE_COW) {
+      // the child gets a private copy anyway
+      flags = (flags | PTE_W) & ~PTE_COW;
+    }
 
     auto opt_mem = kalloc();
     if (!opt_mem.has_value()) {
@@ -325,6 +378,81 @@ auto uvm_copy(uint64_t *old_pagetable, uint64_t *new_pagetable, uint64_t sz)
   return true;
 }
 
+// write fault on a copy-on-write page: the last holder just gets write
+// access back, everyone else gets a private copy.
+auto cow_fault(uint64_t *pagetable, uint64_t va) -> bool {
+  if (va >= VA_MAX) {
+    return false;
+  }
+  auto opt_pte = walk(pagetable, PG_ROUND_DOWN(va), false);
+  if (!opt_pte.has_value()) {
+    return false;
+  }
+  auto *pte = opt_pte.value();
+
+  cow_lock.acquire();
+  if ((*pte & PTE_V) == 0 || (*pte & PTE_U) == 0) {
+    cow_lock.release();
+    return false;
+  }
+  if ((*pte & PTE_COW) == 0) {
+    // another thread got here first
+    auto rs = (*pte & PTE_W) != 0;
+    cow_lock.release();
+    return rs;
+  }
+
+  auto pa = PTE2PA(*pte);
+  auto flags = (PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW;
+
+  kmem.lock.acquire();
+  auto shared = kmem.ref[page_index((void *)pa)] > 1;
+  kmem.lock.release();
+  if (shared == false) {
+    *pte = PA2PTE(pa) | flags;
+    cow_lock.release();
+    return true;
+  }
+
+  auto opt_mem = kalloc();
+  if (!opt_mem.has_value()) {
+    cow_lock.release();
+    return false;
+  }
+  auto *mem = opt_mem.value();
+  std::memmove(mem, (char *)pa, PGSIZE);
+  *pte = PA2PTE((uint64_t)mem) | flags;
+  cow_lock.release();
+  kfree((void *)pa);
+  return true;
+}
+
+// hand the page behind user address va to the kernel: it takes a
+// reference and the mapping turns copy-on-write so later stores by
+// the owner don't show through. returns the physical address.
+auto gift_page(uint64_t *pagetable, uint64_t va) -> uint64_t {
+  if (va >= VA_MAX || va % PGSIZE != 0) {
+    return 0;
+  }
+  auto opt_pte = walk(pagetable, va, false);
+  if (!opt_pte.has_value()) {
+    return 0;
+  }
+  auto *pte = opt_pte.value();
+  cow_lock.acquire();
+  if ((*pte & PTE_V) == 0 || (*pte & PTE_U) == 0) {
+    cow_lock.release();
+    return 0;
+  }
+  if (*pte & PTE_W) {
+    *pte = (*pte & ~PTE_W) | PTE_COW;
+  }
+  auto pa = PTE2PA(*pte);
+  kref((void *)pa);
+  cow_lock.release();
+  return pa;
+}
+
 auto uvm_clear(uint64_t *pagetable, uint64_t va) -> void {
   auto opt_pte = walk(pagetable, va, false);
   if (!opt_pte.has_value()) {
@@ -347,9 +475,14 @@ auto copyout(uint64_t *pagetable, uint64_t dstva, char *src, uint64_t len)
       return false;
     }
     auto *pte = opt_pte.value();
-    if ((*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 || (*pte & PTE_W) == 0) {
+    if ((*pte & PTE_V) == 0 || (*pte & PTE_U) == 0) {
       return false;
     }
+    if ((*pte & PTE_W) == 0) {
+      if (cow_fault(pagetable, va0) == false) {
+        return false;
+      }
+    }
 
     auto pa0 = PTE2PA(*pte);
     auto n = PGSIZE - (dstva - va0);
@@ -433,4 +566,26 @@ auto copyinstr(uint64_t *pagetable, char *dst, uint64_t srcva, uint64_t len)
 
   return fetch_null;
 }
+// a kernel stack is only backed while its process slot is taken. the
+// page below each one stays unmapped as a guard, see KSTACK.
+auto map_kstack(uint64_t va) -> bool {
+  auto opt_pa = kalloc();
+  if (!opt_pa.has_value()) {
+    return false;
+  }
+  kstack_lock.acquire();
+  auto ok = map_pages(kernel_pagetable, va, (uint64_t)opt_pa.value(), PGSIZE,
+                      PTE_R | PTE_W);
+  kstack_lock.release();
+  if (!ok) {
+    kfree(opt_pa.value());
+  }
+  return ok;
+}
+
+auto unmap_kstack(uint64_t va) -> void {
+  kstack_lock.acquire();
+  uvm_unmap(kernel_pagetable, va, 1, true);
+  kstack_lock.release();
+}
 }  // namespace vm
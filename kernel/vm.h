@@ -28,6 +28,10 @@ namespace vm {
 // end -- start of kernel page allocation area
 // PHYSTOP -- end RAM used by the kernel
 
+constexpr uint64_t CLINT{0x02000000ULL};
+// machine software interrupt pending bit of a hart, one word each
+constexpr auto clint_msip(uint64_t hart) -> uint64_t { return CLINT + 4 * hart; }
+
 constexpr uint64_t UART0{0x10000000ULL};
 constexpr uint64_t UART_IRQ{10ULL};
 
@@ -83,6 +87,15 @@ constexpr uint64_t PHY_END{KERNEL_BASE + 128ULL * 1024ULL * 1024ULL};
 
 constexpr uint64_t TRAMPOLINE{VA_MAX - PGSIZE};
 constexpr uint64_t TRAPFRAME{TRAMPOLINE - PGSIZE};
+constexpr uint64_t VDATA{TRAPFRAME - PGSIZE};
+// submission ring page, the completion ring page follows it
+constexpr uint64_t URING{VDATA - 2 * PGSIZE};
+// trapframe of thread slot n of a process, slot 0 is the first thread
+static inline auto THREAD_TRAPFRAME(uint32_t slot) -> uint64_t {
+  return slot == 0 ? TRAPFRAME : URING - static_cast<uint64_t>(slot) * PGSIZE;
+};
+// kernel stack of process table entry n, with an unmapped guard page
+// below it
 static inline auto KSTACK(int pa) -> uint64_t {
   return TRAMPOLINE - static_cast<uint64_t>((pa + 1) * 2) * PGSIZE;
 };
@@ -94,6 +107,7 @@ struct list {
 auto kinit() -> void;
 auto kfree(void *addr) -> void;
 auto kalloc() -> std::optional<uint64_t *>;
+auto kref(void *addr) -> void;
 auto init() -> void;
 auto map_pages(uint64_t *pagetable, uint64_t va, uint64_t pa, uint64_t size,
                uint32_t flag) -> bool;
@@ -103,6 +117,8 @@ auto walkaddr(uint64_t *pagetable, uint64_t va) -> uint64_t;
 auto uvm_first(uint64_t *pagetable, unsigned char *src, uint32_t size) -> void;
 auto uvm_unmap(uint64_t *pagetable, uint64_t va, uint64_t npages, bool do_free)
     -> void;
+auto uvm_detach(uint64_t *pagetable, uint64_t va, uint64_t npages,
+                uint64_t *pa) -> void;
 auto uvm_free(uint64_t *pagetable, uint64_t sz) -> void;
 auto uvm_clear(uint64_t *pagetable, uint64_t va) -> void;
 auto uvm_dealloc(uint64_t *pagetable, uint64_t oldsz, uint64_t newsz)
@@ -117,4 +133,8 @@ auto uvm_copy(uint64_t *old_pagetable, uint64_t *new_pagetable, uint64_t sz)
     -> bool;
 auto copyinstr(uint64_t *pagetable, char *dst, uint64_t srcva, uint64_t len)
     -> bool;
+auto cow_fault(uint64_t *pagetable, uint64_t va) -> bool;
+auto gift_page(uint64_t *pagetable, uint64_t va) -> uint64_t;
+auto map_kstack(uint64_t va) -> bool;
+auto unmap_kstack(uint64_t va) -> void;
 }  // namespace vm
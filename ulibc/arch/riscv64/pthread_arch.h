@@ -6,3 +6,8 @@ static inline uintptr_t __get_tp()
 	__asm__ __volatile__("mv %0, tp" : "=r"(tp));
 	return tp;
 }
+
+static inline void __set_tp(uintptr_t tp)
+{
+	__asm__ __volatile__("mv tp, %0" : : "r"(tp));
+}
@@ -1,8 +1,11 @@
+#include "pthread_arch.h"
 #include "syscall.h"
 
 void _start()
 {
   extern int main();
+  // pthread_self() sets up the main thread the first time tp is zero
+  __set_tp(0);
   main();
   syscall(SYS_exit, 0);
 }
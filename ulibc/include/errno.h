@@ -0,0 +1,17 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int *__errno_location(void);
+#define errno (*__errno_location())
+
+#define EPERM  1
+#define EAGAIN 11
+#define EBUSY  16
+#define EINVAL 22
+#define EWOULDBLOCK EAGAIN
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,13 +4,26 @@
 extern "C" {
 #endif
 
+#include "type.h"
+
 int open(const char *, int);
+int fcntl(int, int, ...);
+ssize_t splice(int, off_t *, int, off_t *, size_t, unsigned);
+ssize_t vmsplice(int, const struct iovec *, size_t, unsigned);
 
 #define O_RDONLY  0x000
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+#define O_NONBLOCK 0x800
+
+#define F_GETFL 3
+#define F_SETFL 4
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
+
+#define SPLICE_F_GIFT 0x08
 
 #ifdef __cplusplus
 }
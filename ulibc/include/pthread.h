@@ -0,0 +1,59 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "type.h"
+
+typedef struct pthread *pthread_t;
+
+typedef struct {
+  size_t stacksize;
+} pthread_attr_t;
+
+typedef struct {
+  volatile int lock;  // 0 free, 1 locked, 2 locked with waiters
+} pthread_mutex_t;
+
+typedef struct {
+  int unused;
+} pthread_mutexattr_t;
+
+typedef struct {
+  volatile int seq;
+} pthread_cond_t;
+
+typedef struct {
+  int unused;
+} pthread_condattr_t;
+
+#define PTHREAD_MUTEX_INITIALIZER {0}
+#define PTHREAD_COND_INITIALIZER {0}
+#define PTHREAD_STACK_MIN 4096
+
+int pthread_attr_init(pthread_attr_t *);
+int pthread_attr_destroy(pthread_attr_t *);
+int pthread_attr_setstacksize(pthread_attr_t *, size_t);
+
+int pthread_create(pthread_t *, const pthread_attr_t *, void *(*)(void *),
+                   void *);
+// from the main thread this ends the whole process
+_Noreturn void pthread_exit(void *);
+int pthread_join(pthread_t, void **);
+pthread_t pthread_self(void);
+
+int pthread_mutex_init(pthread_mutex_t *, const pthread_mutexattr_t *);
+int pthread_mutex_destroy(pthread_mutex_t *);
+int pthread_mutex_lock(pthread_mutex_t *);
+int pthread_mutex_trylock(pthread_mutex_t *);
+int pthread_mutex_unlock(pthread_mutex_t *);
+
+int pthread_cond_init(pthread_cond_t *, const pthread_condattr_t *);
+int pthread_cond_destroy(pthread_cond_t *);
+int pthread_cond_wait(pthread_cond_t *, pthread_mutex_t *);
+int pthread_cond_signal(pthread_cond_t *);
+int pthread_cond_broadcast(pthread_cond_t *);
+
+#ifdef __cplusplus
+}
+#endif
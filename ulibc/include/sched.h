@@ -0,0 +1,42 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "type.h"
+
+#define CPU_SETSIZE 32
+
+typedef struct cpu_set_t {
+  unsigned long __bits[1];
+} cpu_set_t;
+
+#define CPU_ZERO(set) ((set)->__bits[0] = 0)
+#define CPU_SET(i, set) ((set)->__bits[0] |= 1UL << (i))
+#define CPU_CLR(i, set) ((set)->__bits[0] &= ~(1UL << (i)))
+#define CPU_ISSET(i, set) (((set)->__bits[0] >> (i)) & 1)
+
+int sched_setaffinity(pid_t, size_t, const cpu_set_t *);
+int sched_getaffinity(pid_t, size_t, cpu_set_t *);
+
+#define SCHED_OTHER 0
+#define SCHED_DEADLINE 6
+
+// times are in nanoseconds like on linux, the kernel works in
+// microseconds
+struct sched_attr {
+  unsigned size;
+  unsigned sched_policy;
+  unsigned long long sched_flags;
+  int sched_nice;
+  unsigned sched_priority;
+  unsigned long long sched_runtime;
+  unsigned long long sched_deadline;
+  unsigned long long sched_period;
+};
+
+int sched_setattr(pid_t, const struct sched_attr *, unsigned);
+
+#ifdef __cplusplus
+}
+#endif
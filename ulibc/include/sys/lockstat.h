@@ -0,0 +1,30 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// layout shared with kernel/lock.h
+#define LOCKSTAT_NAME 16
+
+#define LOCKSTAT_TAS    0
+#define LOCKSTAT_TICKET 1
+#define LOCKSTAT_MCS    2
+#define LOCKSTAT_SLEEP  3
+
+struct lockstat {
+  char name[LOCKSTAT_NAME];
+  uint32_t kind;
+  uint32_t pad;
+  uint64_t acquired;
+  uint64_t contended;
+  uint64_t wait;
+  uint64_t max_hold;
+};
+
+int lockstat(struct lockstat *, int);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "type.h"
+
+ssize_t sendfile(int, int, off_t *, size_t);
+
+#ifdef __cplusplus
+}
+#endif
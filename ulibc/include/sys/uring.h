@@ -0,0 +1,97 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// layout shared with kernel/uring.h
+#define URING_SQ_ENTRIES 64
+#define URING_CQ_ENTRIES 128
+
+#define URING_OP_NOP   0
+#define URING_OP_READ  1
+#define URING_OP_WRITE 2
+#define URING_OP_OPEN  3
+#define URING_OP_CLOSE 4
+
+struct uring_sqe {
+  uint8_t opcode;
+  uint8_t pad[3];
+  int32_t fd;
+  uint64_t addr;
+  uint32_t len;
+  uint32_t flags;
+  uint64_t user_data;
+};
+
+struct uring_cqe {
+  uint64_t user_data;
+  int32_t res;
+  uint32_t flags;
+};
+
+struct uring_sq {
+  uint32_t head;
+  uint32_t tail;
+  uint32_t mask;
+  uint32_t pad;
+  struct uring_sqe entries[URING_SQ_ENTRIES];
+};
+
+struct uring_cq {
+  uint32_t head;
+  uint32_t tail;
+  uint32_t mask;
+  uint32_t pad;
+  struct uring_cqe entries[URING_CQ_ENTRIES];
+};
+
+struct uring {
+  struct uring_sq *sq;
+  struct uring_cq *cq;
+  uint32_t sqe_tail;  // entries handed out but not yet submitted
+};
+
+int uring_init(struct uring *);
+struct uring_sqe *uring_get_sqe(struct uring *);
+int uring_submit(struct uring *);
+struct uring_cqe *uring_peek_cqe(struct uring *);
+void uring_cqe_seen(struct uring *);
+
+static inline void uring_prep_rw(struct uring_sqe *e, int op, int fd,
+                                 const void *buf, uint32_t len,
+                                 uint64_t user_data) {
+  e->opcode = op;
+  e->fd = fd;
+  e->addr = (uint64_t)buf;
+  e->len = len;
+  e->flags = 0;
+  e->user_data = user_data;
+}
+
+static inline void uring_prep_read(struct uring_sqe *e, int fd, void *buf,
+                                   uint32_t len, uint64_t user_data) {
+  uring_prep_rw(e, URING_OP_READ, fd, buf, len, user_data);
+}
+
+static inline void uring_prep_write(struct uring_sqe *e, int fd,
+                                    const void *buf, uint32_t len,
+                                    uint64_t user_data) {
+  uring_prep_rw(e, URING_OP_WRITE, fd, buf, len, user_data);
+}
+
+static inline void uring_prep_open(struct uring_sqe *e, const char *path,
+                                   int mode, uint64_t user_data) {
+  uring_prep_rw(e, URING_OP_OPEN, -1, path, 0, user_data);
+  e->flags = mode;
+}
+
+static inline void uring_prep_close(struct uring_sqe *e, int fd,
+                                    uint64_t user_data) {
+  uring_prep_rw(e, URING_OP_CLOSE, fd, 0, 0, user_data);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,15 +4,23 @@
 
 int dup(int);
 int pipe(int [2]);
+int pipe2(int [2], int);
 int close(int);
 
 ssize_t read(int, void *, size_t);
 ssize_t write(int, const void *, size_t);
 
 pid_t fork(void);
+pid_t getpid(void);
 int execve(const char *, char *const [], char *const []);
 
 void *sbrk(int);
 
 int setuid(uid_t);
 int setgid(gid_t);
+
+int nice(int);
+
+unsigned sleep(unsigned);
+int usleep(unsigned);
+unsigned long uptime(void);
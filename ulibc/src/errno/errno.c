@@ -0,0 +1,6 @@
+#include <errno.h>
+
+#include "pthread_impl.h"
+
+// every thread has its own errno in its struct pthread
+int *__errno_location(void) { return &pthread_self()->errno_val; }
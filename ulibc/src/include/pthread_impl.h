@@ -1,3 +1,34 @@
+#pragma once
+#include <pthread.h>
 #include <pthread_arch.h>
 
+#include "syscall.h"
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+struct pthread {
+  struct pthread *self;
+  void *(*start)(void *);
+  void *arg;
+  void *result;
+  volatile int tid;  // not 0 while running, the kernel clears it on exit
+  int errno_val;
+  void *map_base;    // the block holding the stack and this struct
+};
+
 #define __pthread_self() ((pthread_t)__get_tp())
+
+hidden int __clone(void (*)(void *), void *, void *, void *, volatile int *);
+hidden void __lock(volatile int *);
+hidden void __unlock(volatile int *);
+
+static inline void __wait(volatile int *addr, int val) {
+  while (*addr == val) {
+    __syscall(SYS_futex, addr, FUTEX_WAIT, val);
+  }
+}
+
+static inline void __wake(volatile int *addr, int cnt) {
+  __syscall(SYS_futex, addr, FUTEX_WAKE, cnt);
+}
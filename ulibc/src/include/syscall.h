@@ -27,10 +27,30 @@ typedef long syscall_arg_t;
 #define SYS_mknod 16
 #define SYS_unlink 17
 #define SYS_link 18
-#define SYS_mkdir 29
+#define SYS_mkdir 19
 #define SYS_close 20
 #define SYS_setuid 21
 #define SYS_setgid 22
+#define SYS_readv 23
+#define SYS_writev 24
+#define SYS_sendfile 25
+#define SYS_splice 26
+#define SYS_poll 27
+#define SYS_epoll_create 28
+#define SYS_epoll_ctl 29
+#define SYS_epoll_wait 30
+#define SYS_fcntl 31
+#define SYS_uring_setup 32
+#define SYS_uring_enter 33
+#define SYS_vmsplice 34
+#define SYS_nice 35
+#define SYS_sched_setaffinity 36
+#define SYS_sched_getaffinity 37
+#define SYS_clone 38
+#define SYS_futex 39
+#define SYS_thread_exit 40
+#define SYS_sched_setdeadline 41
+#define SYS_lockstat 42
 
 hidden long __syscall_ret(unsigned long),
     __syscall_cp(syscall_arg_t, syscall_arg_t, syscall_arg_t, syscall_arg_t,
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+
+// read-only page the kernel maps into every process one page below
+// the trapframe, see struct vdata in kernel/proc.h.
+#define VDATA ((1UL << 38) - 3 * 4096)
+
+struct vdata {
+  uint32_t pid;
+  uint32_t pad;
+  uint64_t boot_jiffies;
+  uint64_t jiffy;
+};
+
+static inline const volatile struct vdata *__vdata(void) {
+  return (const volatile struct vdata *)VDATA;
+}
+
+static inline uint64_t __rdtime(void) {
+  uint64_t t;
+  __asm__ volatile("rdtime %0" : "=r"(t));
+  return t;
+}
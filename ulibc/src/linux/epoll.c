@@ -0,0 +1,19 @@
+#include <sys/epoll.h>
+
+#include "syscall.h"
+
+// the size hint is ignored, as on linux
+int epoll_create(int size) {
+  if (size <= 0) {
+    return -1;
+  }
+  return syscall(SYS_epoll_create);
+}
+
+int epoll_ctl(int fd, int op, int fd2, struct epoll_event *ev) {
+  return syscall(SYS_epoll_ctl, fd, op, fd2, ev);
+}
+
+int epoll_wait(int fd, struct epoll_event *ev, int cnt, int to) {
+  return syscall(SYS_epoll_wait, fd, ev, cnt, to);
+}
@@ -0,0 +1,7 @@
+#include <sys/lockstat.h>
+
+#include "syscall.h"
+
+int lockstat(struct lockstat *st, int n) {
+  return syscall(SYS_lockstat, st, n);
+}
@@ -0,0 +1,46 @@
+#include <sys/uring.h>
+
+#include "syscall.h"
+
+int uring_init(struct uring *r) {
+  long base = syscall(SYS_uring_setup);
+  if (base == -1) {
+    return -1;
+  }
+  r->sq = (struct uring_sq *)base;
+  r->cq = (struct uring_cq *)(base + 4096);
+  r->sqe_tail = r->sq->tail;
+  return 0;
+}
+
+struct uring_sqe *uring_get_sqe(struct uring *r) {
+  uint32_t head = __atomic_load_n(&r->sq->head, __ATOMIC_ACQUIRE);
+  if (r->sqe_tail - head >= URING_SQ_ENTRIES) {
+    return nullptr;
+  }
+  return &r->sq->entries[r->sqe_tail++ & r->sq->mask];
+}
+
+// publish every entry taken since the last call and run them in one
+// trap, returns how many the kernel consumed. entries left over when
+// the completion ring was full go in with the next call.
+int uring_submit(struct uring *r) {
+  __atomic_store_n(&r->sq->tail, r->sqe_tail, __ATOMIC_RELEASE);
+  uint32_t n = r->sqe_tail - __atomic_load_n(&r->sq->head, __ATOMIC_ACQUIRE);
+  if (n == 0) {
+    return 0;
+  }
+  return syscall(SYS_uring_enter, n, 0);
+}
+
+struct uring_cqe *uring_peek_cqe(struct uring *r) {
+  uint32_t tail = __atomic_load_n(&r->cq->tail, __ATOMIC_ACQUIRE);
+  if (r->cq->head == tail) {
+    return nullptr;
+  }
+  return &r->cq->entries[r->cq->head & r->cq->mask];
+}
+
+void uring_cqe_seen(struct uring *r) {
+  __atomic_store_n(&r->cq->head, r->cq->head + 1, __ATOMIC_RELEASE);
+}
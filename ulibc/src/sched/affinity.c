@@ -0,0 +1,23 @@
+#include <sched.h>
+
+#include "syscall.h"
+
+// the kernel keeps one 32-bit hart mask per process
+int sched_setaffinity(pid_t pid, size_t size, const cpu_set_t *set) {
+  if (size < sizeof(cpu_set_t)) {
+    return -1;
+  }
+  return syscall(SYS_sched_setaffinity, pid, (unsigned)set->__bits[0]);
+}
+
+int sched_getaffinity(pid_t pid, size_t size, cpu_set_t *set) {
+  if (size < sizeof(cpu_set_t)) {
+    return -1;
+  }
+  long mask = syscall(SYS_sched_getaffinity, pid);
+  if (mask < 0) {
+    return -1;
+  }
+  set->__bits[0] = (unsigned long)mask;
+  return 0;
+}
@@ -0,0 +1,22 @@
+#include <sched.h>
+
+#include "syscall.h"
+
+// only the deadline parameters are supported, a period of 0 means the
+// same as the deadline
+int sched_setattr(pid_t pid, const struct sched_attr *attr, unsigned flags) {
+  (void)flags;
+  if (attr->sched_policy == SCHED_OTHER) {
+    return syscall(SYS_sched_setdeadline, pid, 0, 0, 0);
+  }
+  // a runtime of 0 would ask for SCHED_OTHER
+  if (attr->sched_policy != SCHED_DEADLINE || attr->sched_runtime < 1000) {
+    return -1;
+  }
+  unsigned long long period = attr->sched_period;
+  if (period == 0) {
+    period = attr->sched_deadline;
+  }
+  return syscall(SYS_sched_setdeadline, pid, attr->sched_runtime / 1000,
+                 attr->sched_deadline / 1000, period / 1000);
+}
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "pthread_impl.h"
+
 typedef long Align;
 
 union header {
@@ -16,6 +18,9 @@ typedef union header Header;
 
 static Header base;
 static Header *freep;
+static volatile int lock[1];
+
+static void free_unlocked(void *ap);
 
 static Header*
 morecore(uint32_t nu)
@@ -30,7 +35,7 @@ morecore(uint32_t nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  free_unlocked((void*)(hp + 1));
   return freep;
 }
 
@@ -42,6 +47,7 @@ malloc(uint32_t nbytes)
   uint32_t nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  __lock(lock);
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -56,16 +62,19 @@ malloc(uint32_t nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
+      __unlock(lock);
       return (void*)(p + 1);
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore(nunits)) == 0){
+        __unlock(lock);
         return 0;
+      }
   }
 }
 
-void
-free(void *ap)
+static void
+free_unlocked(void *ap)
 {
   Header *bp, *p;
 
@@ -85,3 +94,11 @@ free(void *ap)
     p->s.ptr = bp;
   freep = p;
 }
+
+void
+free(void *ap)
+{
+  __lock(lock);
+  free_unlocked(ap);
+  __unlock(lock);
+}
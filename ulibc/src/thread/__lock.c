@@ -0,0 +1,23 @@
+#include "pthread_impl.h"
+
+// internal libc lock, same protocol as pthread_mutex_t
+void __lock(volatile int *l) {
+  int c = 0;
+  if (__atomic_compare_exchange_n(l, &c, 1, 0, __ATOMIC_ACQUIRE,
+                                  __ATOMIC_RELAXED)) {
+    return;
+  }
+  if (c != 2) {
+    c = __atomic_exchange_n(l, 2, __ATOMIC_ACQUIRE);
+  }
+  while (c != 0) {
+    __wait(l, 2);
+    c = __atomic_exchange_n(l, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+void __unlock(volatile int *l) {
+  if (__atomic_exchange_n(l, 0, __ATOMIC_RELEASE) == 2) {
+    __wake(l, 1);
+  }
+}
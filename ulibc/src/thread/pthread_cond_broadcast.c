@@ -0,0 +1,7 @@
+#include "pthread_impl.h"
+
+int pthread_cond_broadcast(pthread_cond_t *c) {
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  __wake(&c->seq, 0x7fffffff);
+  return 0;
+}
@@ -0,0 +1,12 @@
+#include "pthread_impl.h"
+
+int pthread_cond_init(pthread_cond_t *c, const pthread_condattr_t *a) {
+  (void)a;
+  c->seq = 0;
+  return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *c) {
+  (void)c;
+  return 0;
+}
@@ -0,0 +1,7 @@
+#include "pthread_impl.h"
+
+int pthread_cond_signal(pthread_cond_t *c) {
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  __wake(&c->seq, 1);
+  return 0;
+}
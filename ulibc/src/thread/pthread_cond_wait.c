@@ -0,0 +1,14 @@
+#include "pthread_impl.h"
+
+// sleeps until seq moves on from the value seen under the mutex, so a
+// signal sent between the unlock and the futex wait is not lost.
+int pthread_cond_wait(pthread_cond_t *c, pthread_mutex_t *m) {
+  int seq = c->seq;
+  pthread_mutex_unlock(m);
+  __syscall(SYS_futex, &c->seq, FUTEX_WAIT, seq);
+  // there may be other waiters, take the mutex as contended
+  while (__atomic_exchange_n(&m->lock, 2, __ATOMIC_ACQUIRE) != 0) {
+    __wait(&m->lock, 2);
+  }
+  return 0;
+}
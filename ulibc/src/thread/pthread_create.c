@@ -0,0 +1,50 @@
+#include <errno.h>
+#include <stdlib.h>
+
+#include "pthread_impl.h"
+
+#define DEFAULT_STACK_SIZE (64 * 1024)
+
+static void start(void *p) {
+  struct pthread *self = p;
+  pthread_exit(self->start(self->arg));
+}
+
+// the stack and the struct pthread share one block, the struct sits
+// right above the top of the stack.
+int pthread_create(pthread_t *res, const pthread_attr_t *attr,
+                   void *(*entry)(void *), void *arg) {
+  size_t size = attr && attr->stacksize ? attr->stacksize : DEFAULT_STACK_SIZE;
+  size = (size + 15) & -16UL;
+
+  // the caller needs a thread pointer before errno is shared
+  pthread_self();
+
+  unsigned char *map = malloc(size + sizeof(struct pthread));
+  if (map == 0) {
+    return EAGAIN;
+  }
+  struct pthread *new = (struct pthread *)(map + size);
+  new->self = new;
+  new->start = entry;
+  new->arg = arg;
+  new->result = 0;
+  // set before clone, the thread may exit before clone returns here
+  new->tid = 1;
+  new->errno_val = 0;
+  new->map_base = map;
+
+  if (__clone(start, new, new, new, &new->tid) < 0) {
+    free(map);
+    return EAGAIN;
+  }
+  *res = new;
+  return 0;
+}
+
+_Noreturn void pthread_exit(void *result) {
+  pthread_self()->result = result;
+  for (;;) {
+    __syscall(SYS_thread_exit, 0);
+  }
+}
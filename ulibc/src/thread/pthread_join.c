@@ -0,0 +1,15 @@
+#include <stdlib.h>
+
+#include "pthread_impl.h"
+
+int pthread_join(pthread_t t, void **res) {
+  int tid;
+  while ((tid = t->tid) != 0) {
+    __wait(&t->tid, tid);
+  }
+  if (res) {
+    *res = t->result;
+  }
+  free(t->map_base);
+  return 0;
+}
@@ -0,0 +1,12 @@
+#include "pthread_impl.h"
+
+int pthread_mutex_init(pthread_mutex_t *m, const pthread_mutexattr_t *a) {
+  (void)a;
+  m->lock = 0;
+  return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *m) {
+  (void)m;
+  return 0;
+}
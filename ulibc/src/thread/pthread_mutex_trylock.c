@@ -0,0 +1,12 @@
+#include <errno.h>
+
+#include "pthread_impl.h"
+
+int pthread_mutex_trylock(pthread_mutex_t *m) {
+  int c = 0;
+  if (__atomic_compare_exchange_n(&m->lock, &c, 1, 0, __ATOMIC_ACQUIRE,
+                                  __ATOMIC_RELAXED)) {
+    return 0;
+  }
+  return EBUSY;
+}
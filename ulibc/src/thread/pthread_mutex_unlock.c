@@ -0,0 +1,6 @@
+#include "pthread_impl.h"
+
+int pthread_mutex_unlock(pthread_mutex_t *m) {
+  __unlock(&m->lock);
+  return 0;
+}
@@ -0,0 +1,15 @@
+#include "pthread_impl.h"
+
+static struct pthread main_thread;
+
+// the main thread gets its thread pointer on first use
+pthread_t pthread_self(void) {
+  pthread_t self = __pthread_self();
+  if (self == 0) {
+    main_thread.self = &main_thread;
+    main_thread.tid = 1;
+    __set_tp((uintptr_t)&main_thread);
+    self = &main_thread;
+  }
+  return self;
+}
@@ -0,0 +1,32 @@
+# __clone(func, stack, arg, tls, ctid)
+#           a0,    a1,  a2,  a3,   a4
+# syscall(SYS_clone, stack, tls, ctid)
+#                a7,    a0,  a1,   a2
+.global __clone
+.hidden __clone
+.type  __clone, %function
+__clone:
+	# save func and arg on the new stack
+	andi a1, a1, -16
+	addi a1, a1, -16
+	sd a0, 0(a1)
+	sd a2, 8(a1)
+
+	mv a0, a1
+	mv a1, a3
+	mv a2, a4
+	li a7, 38 # SYS_clone
+	ecall
+	beqz a0, 1f
+	# parent
+	ret
+
+	# child, on the new stack
+1:	ld a1, 0(sp)
+	ld a0, 8(sp)
+	jalr a1
+
+	# func does not return, but be safe
+	li a0, 0
+	li a7, 40 # SYS_thread_exit
+	ecall
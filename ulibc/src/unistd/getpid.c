@@ -0,0 +1,5 @@
+#include <unistd.h>
+
+#include "vdata.h"
+
+pid_t getpid(void) { return __vdata()->pid; }
@@ -0,0 +1,12 @@
+#include <unistd.h>
+
+#include "syscall.h"
+
+// the kernel returns 20 - niceness so that it is never negative
+int nice(int inc) {
+  int r = syscall(SYS_nice, inc);
+  if (r < 0) {
+    return -1;
+  }
+  return 20 - r;
+}
@@ -0,0 +1,5 @@
+#include <unistd.h>
+
+#include "syscall.h"
+
+int pipe2(int fd[2], int flag) { return syscall(SYS_pipe, fd, flag); }
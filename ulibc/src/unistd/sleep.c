@@ -0,0 +1,11 @@
+#include <unistd.h>
+
+#include "syscall.h"
+
+// the kernel sleeps in milliseconds
+unsigned sleep(unsigned seconds) {
+  if (syscall(SYS_sleep, seconds * 1000) < 0) {
+    return seconds;
+  }
+  return 0;
+}
@@ -0,0 +1,10 @@
+#include <unistd.h>
+
+#include "vdata.h"
+
+// milliseconds since boot, computed the same way as the kernel's
+// timer::uptime() but without entering it.
+unsigned long uptime(void) {
+  const volatile struct vdata *vd = __vdata();
+  return __rdtime() / vd->jiffy - vd->boot_jiffies;
+}
@@ -0,0 +1,7 @@
+#include <unistd.h>
+
+#include "syscall.h"
+
+int usleep(unsigned useconds) {
+  return syscall(SYS_sleep, (useconds + 999) / 1000);
+}
@@ -1,6 +1,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/sendfile.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -28,6 +29,13 @@ void cat(int fd) {
   ssize_t sz = 0;
   char buf[512];
 
+  // regular files go straight from the buffer cache to stdout
+  while ((sz = sendfile(1, fd, NULL, 4096)) > 0) {
+  }
+  if (sz == 0) {
+    return;
+  }
+
   while ((sz = read(fd, buf, sizeof(buf))) > 0) {
     if (write(1, buf, sz) != sz) {
       printf("cat: write error\n");
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/lockstat.h>
+
+// folds the per-instance records (every proc, inode, buf ...) into one
+// line per lock name and prints them, most contended first
+static const char *kinds[] = {"tas", "ticket", "mcs", "sleep"};
+
+int merge(struct lockstat *st, int n);
+
+int main(void) {
+  int n = lockstat(nullptr, 0);
+  if (n < 0) {
+    printf("lockstat: kernel built without LOCKSTAT\n");
+    exit(1);
+  }
+  struct lockstat *st = malloc(n * sizeof(struct lockstat));
+  if (st == nullptr) {
+    printf("lockstat: out of memory\n");
+    exit(1);
+  }
+  // locks taken for the first time in between are left out
+  n = lockstat(st, n);
+  if (n < 0) {
+    printf("lockstat: read error\n");
+    exit(1);
+  }
+  n = merge(st, n);
+
+  printf("name kind acquired contended wait max_hold\n");
+  for (int i = 0; i < n; ++i) {
+    const char *kind = st[i].kind < 4 ? kinds[st[i].kind] : "?";
+    printf("%s %s %lu %lu %lu %lu\n", st[i].name, kind, st[i].acquired,
+           st[i].contended, st[i].wait, st[i].max_hold);
+  }
+  free(st);
+  return 0;
+}
+
+int merge(struct lockstat *st, int n) {
+  int m = 0;
+  for (int i = 0; i < n; ++i) {
+    int j = 0;
+    while (j < m && (st[j].kind != st[i].kind ||
+                     strncmp(st[j].name, st[i].name, LOCKSTAT_NAME) != 0)) {
+      ++j;
+    }
+    if (j == m) {
+      st[m++] = st[i];
+      continue;
+    }
+    st[j].acquired += st[i].acquired;
+    st[j].contended += st[i].contended;
+    st[j].wait += st[i].wait;
+    if (st[i].max_hold > st[j].max_hold) {
+      st[j].max_hold = st[i].max_hold;
+    }
+  }
+
+  // insertion sort on contended, descending
+  for (int i = 1; i < m; ++i) {
+    struct lockstat cur = st[i];
+    int j = i;
+    for (; j > 0 && st[j - 1].contended < cur.contended; --j) {
+      st[j] = st[j - 1];
+    }
+    st[j] = cur;
+  }
+  return m;
+}